@@ -0,0 +1,128 @@
+#include "Aggregate.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+namespace
+{
+
+int64_t Neutral(AggregateOp op)
+{
+    switch (op)
+    {
+        case AggregateOp::Min:
+            return std::numeric_limits<int64_t>::max();
+        case AggregateOp::Max:
+            return std::numeric_limits<int64_t>::min();
+        default:
+            return 0;
+    }
+}
+
+} // namespace
+
+
+AggregateSpec ParseAggregateSpec(const std::string& text)
+{
+    std::string name = text.substr(0, text.find(':'));
+    std::string attr = text.find(':') == std::string::npos ? "" : text.substr(text.find(':') + 1);
+
+    if (name == "count" and attr.empty())
+        return AggregateSpec{AggregateOp::Count, ""};
+    if (attr.empty())
+        throw std::invalid_argument("Aggregate needs an attribute: " + text);
+    if (name == "sum")
+        return AggregateSpec{AggregateOp::Sum, attr};
+    if (name == "min")
+        return AggregateSpec{AggregateOp::Min, attr};
+    if (name == "max")
+        return AggregateSpec{AggregateOp::Max, attr};
+    throw std::invalid_argument("Unknown aggregate: " + text);
+}
+
+
+std::string AggregateName(const AggregateSpec& spec)
+{
+    switch (spec.op)
+    {
+        case AggregateOp::Sum:
+            return "sum(" + spec.attr + ")";
+        case AggregateOp::Min:
+            return "min(" + spec.attr + ")";
+        case AggregateOp::Max:
+            return "max(" + spec.attr + ")";
+        default:
+            return "count";
+    }
+}
+
+
+GroupTable::GroupTable(size_t keyWidth, std::vector<AggregateOp> ops)
+    : mGroups(keyWidth), mOps(std::move(ops))
+{
+}
+
+
+int64_t* GroupTable::Find(const int* key)
+{
+    bool inserted;
+    size_t group = mGroups.Insert(key, inserted);
+    if (inserted)
+        for (AggregateOp op : mOps)
+            mAccumulators.push_back(Neutral(op));
+    return mAccumulators.data() + group * mOps.size();
+}
+
+
+void GroupTable::Add(const int* key, const int64_t* values, uint64_t multiplicity)
+{
+    if (multiplicity == 0)
+        return;
+
+    int64_t* accumulators = Find(key);
+    for (size_t i = 0; i < mOps.size(); i++)
+    {
+        switch (mOps[i])
+        {
+            case AggregateOp::Count:
+                accumulators[i] += multiplicity;
+                break;
+            case AggregateOp::Sum:
+                accumulators[i] += values[i] * static_cast<int64_t>(multiplicity);
+                break;
+            case AggregateOp::Min:
+                accumulators[i] = std::min(accumulators[i], values[i]);
+                break;
+            case AggregateOp::Max:
+                accumulators[i] = std::max(accumulators[i], values[i]);
+                break;
+        }
+    }
+}
+
+
+void GroupTable::Merge(const GroupTable& other)
+{
+    for (size_t group = 0; group < other.Size(); group++)
+    {
+        int64_t* accumulators = Find(other.Key(group));
+        const int64_t* partials = other.Accumulators(group);
+        for (size_t i = 0; i < mOps.size(); i++)
+        {
+            switch (mOps[i])
+            {
+                case AggregateOp::Min:
+                    accumulators[i] = std::min(accumulators[i], partials[i]);
+                    break;
+                case AggregateOp::Max:
+                    accumulators[i] = std::max(accumulators[i], partials[i]);
+                    break;
+                default:
+                    accumulators[i] += partials[i];
+                    break;
+            }
+        }
+    }
+}
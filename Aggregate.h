@@ -0,0 +1,61 @@
+#pragma once
+
+#include "HashIndex.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+enum class AggregateOp
+{
+    Count,
+    Sum,
+    Min,
+    Max
+};
+
+// One aggregate of the result, attr is empty for Count
+struct AggregateSpec
+{
+    AggregateOp op;
+    std::string attr;
+};
+
+// Parses "count", "sum:A", "min:A" or "max:A"
+AggregateSpec ParseAggregateSpec(const std::string& text);
+
+std::string AggregateName(const AggregateSpec& spec);
+
+
+// Hash table from group keys of keyWidth ints to one int64 accumulator per aggregate. The keys
+// live in a CompositeKeyTable and the accumulators of its entry i at i * ops, so an update
+// touches one slot, one key and one run of accumulators. Every worker fills a table of its own;
+// the partial tables are merged at the end.
+class GroupTable
+{
+public:
+    GroupTable(size_t keyWidth, std::vector<AggregateOp> ops);
+
+    // Adds multiplicity results of the group key whose aggregated attributes hold values, one per
+    // aggregate (ignored for Count)
+    void Add(const int* key, const int64_t* values, uint64_t multiplicity);
+
+    void Merge(const GroupTable& other);
+
+    size_t Size() const { return mGroups.Size(); }
+
+    const int* Key(size_t group) const { return mGroups.Key(group); }
+
+    const int64_t* Accumulators(size_t group) const { return mAccumulators.data() + group * mOps.size(); }
+
+private:
+    // accumulators of the key's group, inserted with neutral values if absent
+    int64_t* Find(const int* key);
+
+private:
+    CompositeKeyTable mGroups;
+    std::vector<AggregateOp> mOps;
+    std::vector<int64_t> mAccumulators;  // mOps.size() per entry of mGroups
+};
@@ -0,0 +1,204 @@
+#include "Bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace
+{
+
+constexpr size_t WordNum = (1 << 16) / 64;
+
+// order preserving map from int to uint32
+inline uint32_t Unsigned(int value)
+{
+    return static_cast<uint32_t>(value) ^ 0x80000000u;
+}
+
+inline int Signed(uint32_t value)
+{
+    return static_cast<int>(value ^ 0x80000000u);
+}
+
+} // namespace
+
+
+RoaringBitmap::RoaringBitmap(const int* keys, size_t keyNum)
+{
+    size_t index = 0;
+    while (index < keyNum)
+    {
+        Container container;
+        container.high = Unsigned(keys[index]) >> 16;
+
+        size_t end = index;
+        while (end < keyNum and (Unsigned(keys[end]) >> 16) == container.high)
+            end++;
+
+        container.cardinality = end - index;
+        if (container.cardinality > ArrayLimit)
+        {
+            container.words.assign(WordNum, 0);
+            for (size_t i = index; i < end; i++)
+            {
+                uint16_t low = Unsigned(keys[i]) & 0xFFFF;
+                container.words[low >> 6] |= uint64_t(1) << (low & 63);
+            }
+        }
+        else
+        {
+            container.array.reserve(container.cardinality);
+            for (size_t i = index; i < end; i++)
+                container.array.push_back(Unsigned(keys[i]) & 0xFFFF);
+        }
+
+        mContainers.emplace_back(std::move(container));
+        index = end;
+    }
+}
+
+
+bool RoaringBitmap::Container::Contains(uint16_t low) const
+{
+    if (IsBitmap())
+        return (words[low >> 6] >> (low & 63)) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+
+bool RoaringBitmap::Contains(int value) const
+{
+    uint16_t high = Unsigned(value) >> 16;
+    auto iter = std::lower_bound(mContainers.begin(), mContainers.end(), high,
+        [](const Container& container, uint16_t h){ return container.high < h; });
+
+    return iter != mContainers.end() and iter->high == high and iter->Contains(Unsigned(value) & 0xFFFF);
+}
+
+
+size_t RoaringBitmap::Cardinality() const
+{
+    size_t cardinality = 0;
+    for (auto& container : mContainers)
+        cardinality += container.cardinality;
+    return cardinality;
+}
+
+
+size_t RoaringBitmap::Bytes() const
+{
+    size_t bytes = mContainers.size() * sizeof(Container);
+    for (auto& container : mContainers)
+        bytes += container.array.size() * sizeof(uint16_t) + container.words.size() * sizeof(uint64_t);
+    return bytes;
+}
+
+
+// Turns a bitmap container that fell below the array limit back into an array
+void RoaringBitmap::Shrink(Container& container)
+{
+    if (!container.IsBitmap() or container.cardinality > ArrayLimit)
+        return;
+
+    container.array.reserve(container.cardinality);
+    for (size_t w = 0; w < WordNum; w++)
+    {
+        uint64_t word = container.words[w];
+        while (word)
+        {
+            container.array.push_back(w * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+    container.words.clear();
+    container.words.shrink_to_fit();
+}
+
+
+RoaringBitmap::Container RoaringBitmap::AndContainer(const Container& c1, const Container& c2)
+{
+    Container result;
+    result.high = c1.high;
+    result.cardinality = 0;
+
+    if (c1.IsBitmap() and c2.IsBitmap())
+    {
+        result.words.resize(WordNum);
+        for (size_t w = 0; w < WordNum; w++)
+        {
+            result.words[w] = c1.words[w] & c2.words[w];
+            result.cardinality += __builtin_popcountll(result.words[w]);
+        }
+        Shrink(result);
+    }
+    else if (c1.IsBitmap() or c2.IsBitmap())
+    {
+        const Container& arrayContainer = c1.IsBitmap() ? c2 : c1;
+        const Container& bitmapContainer = c1.IsBitmap() ? c1 : c2;
+        for (uint16_t low : arrayContainer.array)
+            if (bitmapContainer.Contains(low))
+                result.array.push_back(low);
+        result.cardinality = result.array.size();
+    }
+    else
+    {
+        std::set_intersection(c1.array.begin(), c1.array.end(), c2.array.begin(), c2.array.end(),
+                              std::back_inserter(result.array));
+        result.cardinality = result.array.size();
+    }
+
+    return result;
+}
+
+
+RoaringBitmap RoaringBitmap::And(const RoaringBitmap& bitmap1, const RoaringBitmap& bitmap2)
+{
+    RoaringBitmap result;
+
+    size_t i = 0, j = 0;
+    while (i < bitmap1.mContainers.size() and j < bitmap2.mContainers.size())
+    {
+        auto& c1 = bitmap1.mContainers[i];
+        auto& c2 = bitmap2.mContainers[j];
+        if (c1.high < c2.high)
+            i++;
+        else if (c1.high > c2.high)
+            j++;
+        else
+        {
+            Container container = AndContainer(c1, c2);
+            if (container.cardinality > 0)
+                result.mContainers.emplace_back(std::move(container));
+            i++;
+            j++;
+        }
+    }
+
+    return result;
+}
+
+
+void RoaringBitmap::Collect(std::vector<int>& values) const
+{
+    for (auto& container : mContainers)
+    {
+        uint32_t base = uint32_t(container.high) << 16;
+        if (container.IsBitmap())
+        {
+            for (size_t w = 0; w < WordNum; w++)
+            {
+                uint64_t word = container.words[w];
+                while (word)
+                {
+                    values.push_back(Signed(base | (w * 64 + __builtin_ctzll(word))));
+                    word &= word - 1;
+                }
+            }
+        }
+        else
+        {
+            for (uint16_t low : container.array)
+                values.push_back(Signed(base | low));
+        }
+    }
+}
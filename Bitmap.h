@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Roaring-style compressed bitmap over int values. Values are split by their high 16 bits into
+// containers; a container is a sorted uint16 array while sparse and a 2^16-bit bitmap once it
+// holds more than ArrayLimit values.
+class RoaringBitmap
+{
+public:
+    static constexpr size_t ArrayLimit = 4096;
+
+    RoaringBitmap() {}
+
+    // keys must be sorted and distinct
+    RoaringBitmap(const int* keys, size_t keyNum);
+
+    bool Contains(int value) const;
+
+    size_t Cardinality() const;
+
+    // Memory held by the containers
+    size_t Bytes() const;
+
+    // Container-wise intersection: word AND + popcount for bitmap pairs, bit probes for
+    // array/bitmap pairs and a merge for array pairs.
+    static RoaringBitmap And(const RoaringBitmap& bitmap1, const RoaringBitmap& bitmap2);
+
+    // Appends every value in ascending order
+    void Collect(std::vector<int>& values) const;
+
+private:
+    struct Container
+    {
+        uint16_t high;
+        size_t cardinality;
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> words;
+
+        bool IsBitmap() const { return !words.empty(); }
+
+        bool Contains(uint16_t low) const;
+    };
+
+    static Container AndContainer(const Container& c1, const Container& c2);
+
+    static void Shrink(Container& container);
+
+    std::vector<Container> mContainers; // sorted by high
+};
@@ -0,0 +1,165 @@
+#include "Calibration.h"
+#include "Bitmap.h"
+#include "Intersection.h"
+#include "Relation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+namespace
+{
+
+constexpr size_t ColumnLength = 1 << 20;
+constexpr size_t ProbeNum = 1 << 16;
+
+// keeps the measured loops from being optimized away
+volatile size_t Sink;
+
+template<typename Func>
+double TimeNs(Func&& func)
+{
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// strictly increasing column with random gaps of 1 to 4
+std::vector<int> SortedColumn(std::mt19937& rng, size_t length)
+{
+    std::vector<int> column(length);
+    int value = 0;
+    for (auto& slot : column)
+        slot = value += 1 + rng() % 4;
+    return column;
+}
+
+} // namespace
+
+
+IntersectCosts CalibrateIntersectCosts()
+{
+    IntersectCosts costs;
+    std::mt19937 rng(7);
+    const double searchSteps = std::log2(ColumnLength);
+
+    std::vector<int> column = SortedColumn(rng, ColumnLength);
+    std::vector<int> other = SortedColumn(rng, ColumnLength);
+    std::vector<int> probes(ProbeNum);
+    for (auto& probe : probes)
+        probe = rng() % column.back();
+
+    costs.searchStep = TimeNs([&]{
+        size_t sum = 0;
+        for (int probe : probes)
+            sum += std::lower_bound(column.begin(), column.end(), probe) - column.begin();
+        Sink = sum;
+    }) / (ProbeNum * searchSteps);
+
+    // the same search through a permutation, as over the sort index of a range table
+    std::vector<int> shuffled = column;
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+    std::vector<uint32_t> sortIndex(ColumnLength);
+    std::iota(sortIndex.begin(), sortIndex.end(), 0);
+    std::sort(sortIndex.begin(), sortIndex.end(), [&](uint32_t i1, uint32_t i2){ return shuffled[i1] < shuffled[i2]; });
+    costs.indirectSearchStep = TimeNs([&]{
+        size_t sum = 0;
+        for (int probe : probes)
+            sum += std::lower_bound(sortIndex.begin(), sortIndex.end(), probe,
+                [&](uint32_t index, int value){ return shuffled[index] < value; }) - sortIndex.begin();
+        Sink = sum;
+    }) / (ProbeNum * searchSteps);
+
+    // ascending probes with a forward-only cursor, about 2 log2(gap) steps each
+    std::vector<int> sortedProbes = probes;
+    std::sort(sortedProbes.begin(), sortedProbes.end());
+    costs.gallopStep = TimeNs([&]{
+        size_t cursor = 0;
+        for (int probe : sortedProbes)
+            cursor = GallopLowerBound(column.data(), cursor, ColumnLength, probe);
+        Sink = cursor;
+    }) / (ProbeNum * 2 * std::log2(ColumnLength / ProbeNum + 1));
+
+    std::vector<int> out(ColumnLength);
+    costs.mergeKey = TimeNs([&]{
+        Sink = IntersectSorted(column.data(), ColumnLength, other.data(), ColumnLength, out.data());
+    }) / (2 * ColumnLength);
+
+    costs.cursorStep = TimeNs([&]{
+        size_t i = 0, j = 0, common = 0;
+        while (i < ColumnLength and j < ColumnLength)
+        {
+            common += column[i] == other[j];
+            bool advanceI = column[i] <= other[j];
+            bool advanceJ = other[j] <= column[i];
+            i += advanceI;
+            j += advanceJ;
+        }
+        Sink = common;
+    }) / (2 * ColumnLength);
+
+    RoaringBitmap bitmap(column.data(), ColumnLength);
+    costs.bitmapProbe = TimeNs([&]{
+        size_t found = 0;
+        for (int probe : probes)
+            found += bitmap.Contains(probe);
+        Sink = found;
+    }) / ProbeNum;
+
+    return costs;
+}
+
+
+void SaveIntersectCosts(const IntersectCosts& costs, const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to write calibration file: " + path);
+
+    file << "searchStep " << costs.searchStep << "\n"
+         << "indirectSearchStep " << costs.indirectSearchStep << "\n"
+         << "gallopStep " << costs.gallopStep << "\n"
+         << "mergeKey " << costs.mergeKey << "\n"
+         << "cursorStep " << costs.cursorStep << "\n"
+         << "bitmapProbe " << costs.bitmapProbe << "\n";
+}
+
+
+IntersectCosts LoadIntersectCosts(const std::string& path)
+{
+    IntersectCosts costs;
+    std::map<std::string, double*> fields{
+        {"searchStep", &costs.searchStep}, {"indirectSearchStep", &costs.indirectSearchStep},
+        {"gallopStep", &costs.gallopStep}, {"mergeKey", &costs.mergeKey},
+        {"cursorStep", &costs.cursorStep}, {"bitmapProbe", &costs.bitmapProbe},
+    };
+
+    std::ifstream file(path);
+    std::string name;
+    double value;
+    size_t loaded = 0;
+    while (file >> name >> value)
+    {
+        auto iter = fields.find(name);
+        if (iter != fields.end())
+        {
+            *iter->second = value;
+            loaded++;
+        }
+    }
+    if (loaded == fields.size())
+        return costs;
+
+    std::cout << "Calibrating intersection costs into " << path << std::endl;
+    costs = CalibrateIntersectCosts();
+    SaveIntersectCosts(costs, path);
+    return costs;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+
+// Per-operation costs of the intersection strategies on this machine in nanoseconds, measured by
+// a microbenchmark over synthetic sorted columns of 1M ints. The adaptive intersection and loop
+// join modes multiply them with the operation counts they expect from the range lengths.
+struct IntersectCosts
+{
+    double searchStep = 4;          // one halving step of std::lower_bound
+    double indirectSearchStep = 12; // one step of a binary search through a sort index
+    double gallopStep = 4;          // one doubling or halving step of an exponential search
+    double mergeKey = 1;            // one input key of IntersectSorted
+    double cursorStep = 2;          // one step of a forward-only merge cursor
+    double bitmapProbe = 3;         // one RoaringBitmap::Contains
+};
+
+IntersectCosts CalibrateIntersectCosts();
+
+// Reads the costs from path if it holds them, otherwise calibrates and writes them there, so
+// each machine runs the microbenchmark once
+IntersectCosts LoadIntersectCosts(const std::string& path);
+
+void SaveIntersectCosts(const IntersectCosts& costs, const std::string& path);
@@ -0,0 +1,153 @@
+#include "CoverLP.h"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace
+{
+
+constexpr double Epsilon = 1e-9;
+
+constexpr size_t NoRow = std::numeric_limits<size_t>::max();
+
+} // namespace
+
+
+void CoverLPSolver::TakeEdge(size_t edge, const std::vector<std::vector<size_t>>& vertexEdges)
+{
+    mCover[edge] = 1.0;
+    for (size_t vertex = 0; vertex < vertexEdges.size(); vertex++)
+        if (!mCovered[vertex] and std::find(vertexEdges[vertex].begin(), vertexEdges[vertex].end(), edge) != vertexEdges[vertex].end())
+            mCovered[vertex] = true;
+}
+
+
+const std::vector<double>& CoverLPSolver::Solve(const std::vector<double>& weights, const std::vector<std::vector<size_t>>& vertexEdges)
+{
+    const size_t edgeNum = weights.size();
+    const size_t vertexNum = vertexEdges.size();
+    mCover.assign(edgeNum, 0.0);
+    mCovered.assign(vertexNum, false);
+    for (size_t vertex = 0; vertex < vertexNum; vertex++)
+        mCovered[vertex] = vertexEdges[vertex].empty();
+
+    // edges that cost nothing, and the only edge of a vertex, are taken whole
+    for (size_t vertex = 0; vertex < vertexNum; vertex++)
+        for (size_t edge : vertexEdges[vertex])
+            if (!mCovered[vertex] and weights[edge] <= 0)
+                TakeEdge(edge, vertexEdges);
+    for (size_t vertex = 0; vertex < vertexNum; vertex++)
+        if (!mCovered[vertex] and vertexEdges[vertex].size() == 1)
+            TakeEdge(vertexEdges[vertex][0], vertexEdges);
+
+    mUncovered.clear();
+    for (size_t vertex = 0; vertex < vertexNum; vertex++)
+        if (!mCovered[vertex])
+            mUncovered.push_back(vertex);
+    if (mUncovered.empty())
+        return mCover;
+
+    mEdges.clear();
+    mEdgeRow.assign(edgeNum, NoRow);
+    mEdgeLoad.clear();
+    for (size_t vertex : mUncovered)
+        for (size_t edge : vertexEdges[vertex])
+        {
+            if (mEdgeRow[edge] == NoRow)
+            {
+                mEdgeRow[edge] = mEdges.size();
+                mEdges.push_back(edge);
+                mEdgeLoad.push_back(0);
+            }
+            mEdgeLoad[mEdgeRow[edge]]++;
+        }
+
+    // no edge shares two uncovered vertices: the LP splits into one constraint per vertex
+    if (std::all_of(mEdgeLoad.begin(), mEdgeLoad.end(), [](size_t load){ return load <= 1; }))
+    {
+        for (size_t vertex : mUncovered)
+        {
+            auto& edges = vertexEdges[vertex];
+            size_t cheapest = *std::min_element(edges.begin(), edges.end(), [&](size_t e1, size_t e2){ return weights[e1] < weights[e2]; });
+            mCover[cheapest] = 1.0;
+        }
+        return mCover;
+    }
+
+    Simplex(weights, vertexEdges);
+    return mCover;
+}
+
+
+void CoverLPSolver::Simplex(const std::vector<double>& weights, const std::vector<std::vector<size_t>>& vertexEdges)
+{
+    const size_t rowNum = mEdges.size();
+    const size_t varNum = mUncovered.size();
+    const size_t colNum = varNum + rowNum + 1;
+    const size_t rhs = colNum - 1;
+    auto cell = [&](size_t row, size_t col) -> double& { return mTableau[row * colNum + col]; };
+
+    // rows: sum of y_v over the uncovered vertices of an edge plus its slack equals its weight
+    mTableau.assign(rowNum * colNum, 0.0);
+    mBasis.resize(rowNum);
+    for (size_t var = 0; var < varNum; var++)
+        for (size_t edge : vertexEdges[mUncovered[var]])
+            cell(mEdgeRow[edge], var) = 1.0;
+    for (size_t row = 0; row < rowNum; row++)
+    {
+        cell(row, varNum + row) = 1.0;
+        cell(row, rhs) = weights[mEdges[row]];
+        mBasis[row] = varNum + row;
+    }
+    mObjective.assign(colNum, 0.0);
+    for (size_t var = 0; var < varNum; var++)
+        mObjective[var] = -1.0;
+
+    // Bland's rule cannot cycle; the bound only guards against numerical trouble
+    const size_t maxPivots = 64 * colNum;
+    for (size_t pivots = 0; pivots < maxPivots; pivots++)
+    {
+        size_t enter = 0;
+        while (enter < rhs and mObjective[enter] >= -Epsilon)
+            enter++;
+        if (enter == rhs)
+            break;
+
+        size_t leave = NoRow;
+        double bestRatio = 0;
+        for (size_t row = 0; row < rowNum; row++)
+        {
+            if (cell(row, enter) <= Epsilon)
+                continue;
+            double ratio = cell(row, rhs) / cell(row, enter);
+            if (leave == NoRow or ratio < bestRatio - Epsilon or (ratio <= bestRatio + Epsilon and mBasis[row] < mBasis[leave]))
+            {
+                leave = row;
+                bestRatio = ratio;
+            }
+        }
+        if (leave == NoRow)
+            break;
+
+        const double pivot = cell(leave, enter);
+        for (size_t col = 0; col < colNum; col++)
+            cell(leave, col) /= pivot;
+        for (size_t row = 0; row < rowNum; row++)
+        {
+            const double factor = cell(row, enter);
+            if (row == leave or factor == 0)
+                continue;
+            for (size_t col = 0; col < colNum; col++)
+                cell(row, col) -= factor * cell(leave, col);
+        }
+        const double factor = mObjective[enter];
+        for (size_t col = 0; col < colNum; col++)
+            mObjective[col] -= factor * cell(leave, col);
+        mBasis[leave] = enter;
+    }
+
+    // the cover is the dual of the packing: the reduced costs of the slacks
+    for (size_t row = 0; row < rowNum; row++)
+        mCover[mEdges[row]] = std::clamp(mObjective[varNum + row], 0.0, 1.0);
+}
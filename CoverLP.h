@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Minimum weight fractional edge cover of a hypergraph, the LP behind the AGM bound:
+//     minimize sum_e w_e x_e  subject to  sum_{e contains v} x_e >= 1 for every vertex v, 0 <= x_e <= 1.
+// The optimizers solve thousands of these with a handful of edges each, so the solver is made
+// for that size. Edges of non-positive weight are taken whole, and so is the only edge of a
+// vertex; once every remaining edge holds at most one uncovered vertex, each vertex takes its
+// cheapest edge. Acyclic queries usually end there. What remains is solved as the dual
+// packing LP, maximize sum_v y_v subject to sum_{v in e} y_v <= w_e, y >= 0, by a dense
+// tableau simplex with Bland's rule: its origin is feasible, so no first phase is needed, and
+// the cover is read off the reduced costs of the slacks. The buffers are kept between calls.
+class CoverLPSolver
+{
+public:
+    // vertexEdges[v] lists the edges containing vertex v; vertices in no edge are ignored
+    const std::vector<double>& Solve(const std::vector<double>& weights, const std::vector<std::vector<size_t>>& vertexEdges);
+
+private:
+    // Sets x_edge = 1 and marks the vertices of edge covered
+    void TakeEdge(size_t edge, const std::vector<std::vector<size_t>>& vertexEdges);
+
+    void Simplex(const std::vector<double>& weights, const std::vector<std::vector<size_t>>& vertexEdges);
+
+private:
+    std::vector<double> mCover;
+    std::vector<bool> mCovered;
+    std::vector<size_t> mUncovered;     // vertices left for the simplex
+    std::vector<size_t> mEdges;         // edges left for the simplex
+    std::vector<size_t> mEdgeRow;       // row of an edge in the tableau
+    std::vector<size_t> mEdgeLoad;      // uncovered vertices per row
+    std::vector<double> mTableau;       // mEdges.size() rows of mUncovered.size() + mEdges.size() + 1 columns
+    std::vector<double> mObjective;
+    std::vector<size_t> mBasis;
+};
@@ -1,44 +1,95 @@
 #include "Estimator.h"
+#include "CoverLP.h"
+#include "Sampler.h"
 
+#ifdef WITH_ORTOOLS
 #include "absl/flags/flag.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
 #include "ortools/linear_solver/linear_solver.h"
 #include "ortools/linear_solver/linear_solver.pb.h"
 
+using namespace operations_research;
+#endif
+
+#include <algorithm>
 #include <cmath>
 #include <exception>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
-using namespace operations_research;
 
-namespace
+double Estimator::operator()(std::string_view solveId)
 {
+    std::vector<double> fractionalCovers = LinearProgramming(solveId);
 
+    double result = 1;
+    for (size_t relIndex = 0; relIndex < mRelations.size(); relIndex++)
+    {
+        result *= std::pow((double)mRelations[relIndex].get().Length(), fractionalCovers[relIndex]);
+    }
 
+    return result;
+}
 
-    
-} // namespace
 
+namespace
+{
+
+// Hybrid estimates with a larger relative standard error fall back to the bound
+constexpr double MaxHybridError = 0.5;
 
+} // namespace
 
-double Estimator::operator()(std::string_view solveId)
-{
-    std::vector<double> fractionalCovers = LinearProgramming(solveId);
 
-    double result = 1;
-    for (int relIndex = 0; relIndex < mRelations.size(); relIndex++)
+std::string EstimateModelName(EstimateModel model)
+{
+    switch (model)
     {
-        result *= std::pow((double)mRelations[relIndex].get().Length(), fractionalCovers[relIndex]);
+        case EstimateModel::Degree:
+            return "degree";
+        case EstimateModel::Sample:
+            return "sample";
+        case EstimateModel::Hybrid:
+            return "hybrid";
+        default:
+            return "agm";
     }
+}
 
-    return result;
+
+double Estimator::operator()()
+{
+    return EstimateCache::Shared().Estimate(mRelations, mAttrs, mModel, [this]() {
+        if (mModel == EstimateModel::Agm)
+            return operator()(sDefaultSolver);
+        if (mModel == EstimateModel::Degree)
+            return DegreeBound();
+
+        double relativeError;
+        double sample = JoinSampler::Shared().Estimate(mRelations, mAttrs, relativeError);
+        // without a surviving walk there is no sample to trust, hybrid falls back by its error
+        if (mModel == EstimateModel::Sample)
+            return sample > 0 ? sample : DegreeBound();
+        double bound = operator()(sDefaultSolver);
+        return relativeError <= MaxHybridError ? std::min(sample, bound) : bound;
+    });
 }
 
 
-std::vector<double> Estimator::LinearProgramming(absl::string_view solveId)
+std::vector<double> Estimator::LinearProgramming(std::string_view solveId)
 {
+    if (solveId == "BUILTIN")
+        return BuiltinLinearProgramming();
+
+#ifndef WITH_ORTOOLS
+    throw std::invalid_argument("LP solver " + std::string(solveId) + " needs a build with or-tools (make ORTOOLS=1)");
+#else
     MPSolver::OptimizationProblemType problemType;
-    if (!MPSolver::ParseSolverType(solveId, &problemType))
+    if (!MPSolver::ParseSolverType(std::string(solveId), &problemType))
     {
         throw std::invalid_argument("Unknown solver.");
     }
@@ -102,6 +153,123 @@ std::vector<double> Estimator::LinearProgramming(absl::string_view solveId)
     }
 
     return result;
+#endif
+}
+
+
+// The same LP through CoverLPSolver, whose buffers each thread keeps between estimates
+std::vector<double> Estimator::BuiltinLinearProgramming()
+{
+    thread_local CoverLPSolver solver;
+
+    std::vector<std::vector<size_t>> vertexEdges;
+    for (auto& attr : mAttrs)
+        vertexEdges.emplace_back(relIndicesWithAtttr(attr));
+
+    return solver.Solve(EdgeLogWeight(), vertexEdges);
+}
+
+
+double Estimator::DegreeBound()
+{
+    thread_local CoverLPSolver solver;
+
+    const size_t attrNum = mAttrs.size();
+    std::vector<std::vector<size_t>> edges;
+    std::vector<double> weights;
+    auto addEdge = [&](std::vector<size_t> edge, size_t bound) {
+        edges.push_back(std::move(edge));
+        weights.push_back(std::log((double)bound));
+    };
+
+    // sizes of the relations and distinct values of their attributes, which hold along every order
+    std::vector<std::vector<size_t>> relationAttrs(mRelations.size());
+    for (size_t relIndex = 0; relIndex < mRelations.size(); relIndex++)
+    {
+        Relation& relation = mRelations[relIndex].get();
+        for (size_t attrIndex = 0; attrIndex < attrNum; attrIndex++)
+            if (relation.ExistAttr(mAttrs[attrIndex]))
+                relationAttrs[relIndex].push_back(attrIndex);
+        if (relationAttrs[relIndex].empty())
+            continue;
+
+        addEdge(relationAttrs[relIndex], relation.Length());
+        for (size_t attrIndex : relationAttrs[relIndex])
+            addEdge({attrIndex}, relation[mAttrs[attrIndex]].get().Degrees().distinct);
+    }
+    const size_t orderFreeEdgeNum = edges.size();
+
+    // deg(Y|a): the other attributes of a relation per value of its attribute a
+    std::vector<size_t> conditions;
+    for (size_t relIndex = 0; relIndex < mRelations.size(); relIndex++)
+    {
+        if (relationAttrs[relIndex].size() < 2)
+            continue;
+        for (size_t attrIndex : relationAttrs[relIndex])
+        {
+            std::vector<size_t> rest;
+            for (size_t other : relationAttrs[relIndex])
+                if (other != attrIndex)
+                    rest.push_back(other);
+            conditions.push_back(attrIndex);
+            addEdge(std::move(rest), mRelations[relIndex].get()[mAttrs[attrIndex]].get().Degrees().maxDegree);
+        }
+    }
+
+    if (edges.empty())
+        return 1;
+
+    double bestLogBound = std::numeric_limits<double>::infinity();
+    std::vector<size_t> position(attrNum);
+    std::vector<bool> bound(attrNum);
+    std::vector<std::vector<size_t>> vertexEdges(attrNum);
+    for (size_t first = 0; first < attrNum; first++)
+    {
+        // extend the order by the attribute whose rows per bound value, or distinct values, are fewest
+        std::fill(bound.begin(), bound.end(), false);
+        for (size_t pos = 0; pos < attrNum; pos++)
+        {
+            size_t next = first;
+            if (pos > 0)
+            {
+                std::vector<double> cost(attrNum, std::numeric_limits<double>::infinity());
+                for (size_t edge = 0; edge < edges.size(); edge++)
+                {
+                    bool usable = edge < orderFreeEdgeNum ? edges[edge].size() == 1 : bound[conditions[edge - orderFreeEdgeNum]];
+                    for (size_t attrIndex : edges[edge])
+                        if (usable)
+                            cost[attrIndex] = std::min(cost[attrIndex], weights[edge]);
+                }
+                next = attrNum;
+                for (size_t attrIndex = 0; attrIndex < attrNum; attrIndex++)
+                    if (!bound[attrIndex] and (next == attrNum or cost[attrIndex] < cost[next]))
+                        next = attrIndex;
+            }
+            bound[next] = true;
+            position[next] = pos;
+        }
+
+        for (auto& incident : vertexEdges)
+            incident.clear();
+        for (size_t edge = 0; edge < edges.size(); edge++)
+        {
+            bool consistent = edge < orderFreeEdgeNum or std::all_of(edges[edge].begin(), edges[edge].end(), [&](size_t attrIndex){
+                return position[conditions[edge - orderFreeEdgeNum]] < position[attrIndex];
+            });
+            if (consistent)
+                for (size_t attrIndex : edges[edge])
+                    vertexEdges[attrIndex].push_back(edge);
+        }
+
+        const std::vector<double>& cover = solver.Solve(weights, vertexEdges);
+        double logBound = 0;
+        for (size_t edge = 0; edge < edges.size(); edge++)
+            if (cover[edge] > 0)
+                logBound += cover[edge] * weights[edge];
+        bestLogBound = std::min(bestLogBound, logBound);
+    }
+
+    return std::exp(bestLogBound);
 }
 
 
@@ -109,7 +277,7 @@ std::vector<double> Estimator::EdgeLogWeight() const
 {
     std::vector<double> logW(mRelations.size());
 
-    for (int i = 0; i < logW.size(); i++)
+    for (size_t i = 0; i < logW.size(); i++)
         logW[i] = std::log((double)mRelations[i].get().Length());
 
     return logW;
@@ -127,3 +295,144 @@ std::vector<size_t> Estimator::relIndicesWithAtttr(std::string_view attr)
 
     return relIndices;
 }
+
+
+EstimateCache& EstimateCache::Shared()
+{
+    static EstimateCache cache;
+    return cache;
+}
+
+
+void EstimateCache::Bind(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs)
+{
+    bool same = mRelationBits.size() == relations.size() and mAttrBits.size() == attrs.size();
+    for (size_t i = 0; same and i < relations.size(); i++)
+    {
+        auto iter = mRelationBits.find(&relations[i].get());
+        same = iter != mRelationBits.end() and iter->second == i;
+    }
+    for (size_t i = 0; same and i < attrs.size(); i++)
+    {
+        auto iter = mAttrBits.find(attrs[i]);
+        same = iter != mAttrBits.end() and iter->second == i;
+    }
+    if (same)
+        return;
+
+    mRelationBits.clear();
+    mAttrBits.clear();
+    mEstimates.clear();
+    for (size_t i = 0; i < relations.size(); i++)
+        mRelationBits.emplace(&relations[i].get(), i);
+    for (size_t i = 0; i < attrs.size(); i++)
+        mAttrBits.emplace(attrs[i], i);
+}
+
+
+bool EstimateCache::MakeKey(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, Key& key) const
+{
+    key = Key{0, 0, EstimateModel::Agm};
+    for (const auto& relation : relations)
+    {
+        auto iter = mRelationBits.find(&relation.get());
+        if (iter == mRelationBits.end() or iter->second >= 64)
+            return false;
+        key.relations |= uint64_t(1) << iter->second;
+    }
+    for (const auto& attr : attrs)
+    {
+        auto iter = mAttrBits.find(attr);
+        if (iter == mAttrBits.end() or iter->second >= 64)
+            return false;
+        key.attrs |= uint64_t(1) << iter->second;
+    }
+    return true;
+}
+
+
+std::string EstimateCache::PersistentKey(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, EstimateModel model)
+{
+    std::vector<std::string> names;
+    for (const auto& relation : relations)
+        names.push_back(relation.get().Name() + ":" + std::to_string(relation.get().Length()));
+    std::sort(names.begin(), names.end());
+
+    std::vector<std::string> sortedAttrs(attrs);
+    std::sort(sortedAttrs.begin(), sortedAttrs.end());
+    sortedAttrs.erase(std::unique(sortedAttrs.begin(), sortedAttrs.end()), sortedAttrs.end());
+
+    std::string key = EstimateModelName(model) + ' ';
+    key += names.empty() ? "-" : "";
+    for (size_t i = 0; i < names.size(); i++)
+        key += (i == 0 ? "" : ",") + names[i];
+    key += sortedAttrs.empty() ? " -" : " ";
+    for (size_t i = 0; i < sortedAttrs.size(); i++)
+        key += (i == 0 ? "" : ",") + sortedAttrs[i];
+    return key;
+}
+
+
+double EstimateCache::Estimate(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, EstimateModel model, const std::function<double()>& estimate)
+{
+    Key key;
+    bool cached = MakeKey(relations, attrs, key);
+    key.model = model;
+    if (cached)
+    {
+        auto iter = mEstimates.find(key);
+        if (iter != mEstimates.end())
+        {
+            mHits++;
+            return iter->second;
+        }
+    }
+
+    double result;
+    std::string persistentKey = mPath.empty() ? "" : PersistentKey(relations, attrs, model);
+    auto iter = mSaved.find(persistentKey);
+    if (!mPath.empty() and iter != mSaved.end())
+    {
+        mLoaded++;
+        result = iter->second;
+    }
+    else
+    {
+        mMisses++;
+        result = estimate();
+        if (!mPath.empty())
+            mSaved.emplace(std::move(persistentKey), result);
+    }
+
+    if (cached)
+        mEstimates.emplace(key, result);
+    return result;
+}
+
+
+void EstimateCache::Load(const std::string& path)
+{
+    mPath = path;
+
+    // one line per estimate: model, relations, attributes and the estimate, separated by spaces
+    std::ifstream file(path);
+    std::string model, relations, attrs;
+    double value;
+    while (file >> model >> relations >> attrs >> value)
+        mSaved[model + ' ' + relations + ' ' + attrs] = value;
+}
+
+
+void EstimateCache::Save() const
+{
+    if (mPath.empty())
+        return;
+
+    std::ofstream file(mPath);
+    if (!file)
+        throw std::runtime_error("Cannot write estimates to " + mPath);
+
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (const auto& [key, value] : mSaved)
+        file << key << ' ' << value << '\n';
+}
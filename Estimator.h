@@ -2,23 +2,43 @@
 
 #include "Relation.h"
 
-#include "absl/strings/string_view.h"
-
+#include <cstdint>
+#include <functional>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
+// What the optimizers' estimates bound
+enum class EstimateModel
+{
+    Agm,        // the AGM bound from the relation sizes
+    Degree,     // the degree-aware bound, also from the distinct values and max degrees of the columns
+    Sample,     // the random walk estimate of JoinSampler, or the degree-aware bound if no walk survives
+    Hybrid      // the random walk estimate capped by the AGM bound, or the bound if the walks are too noisy
+};
+
+std::string EstimateModelName(EstimateModel model);
+
+
 class Estimator
 {
 public:
-    Estimator(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs)
-        : mRelations(relations), mAttrs(attrs)
+    Estimator(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, EstimateModel model = EstimateModel::Agm)
+        : mRelations(relations), mAttrs(attrs), mModel(model)
     {
     }
 
+    // AGM bound of the join from a minimum fractional edge cover. solverId is BUILTIN for the
+    // in-tree CoverLPSolver, or an or-tools solver such as GLOP in builds with or-tools.
     double operator()(std::string_view solverId);
 
+    // The bound of the model, the AGM one with the default solver, looked up in EstimateCache::Shared() first
+    double operator()();
+
+    static void SetDefaultSolver(std::string_view solverId) { sDefaultSolver = solverId; }
+
 private:
     struct HyperEdge
     {
@@ -32,7 +52,20 @@ private:
         }
     };
 
-    std::vector<double> LinearProgramming(absl::string_view solverId);
+    std::vector<double> LinearProgramming(std::string_view solverId);
+
+    std::vector<double> BuiltinLinearProgramming();
+
+    // Polymatroid bound under the cardinality, distinct value and max degree constraints of the
+    // relations. A constraint deg(Y|a) <= d bounds the rows of Y per value of attribute a, so it
+    // only applies along orders that bind a before Y. Under the constraints of one such order the
+    // polymatroid bound equals its modular relaxation, maximize sum_v z_v subject to
+    // sum_{v in Y} z_v <= log d, which is a packing LP of the same form as the AGM one and is
+    // solved by CoverLPSolver. Every attribute starts one order, extended greedily by the attribute
+    // with the smallest degree from the ones bound so far, and the smallest bound is taken; it is
+    // never above the AGM bound, whose constraints hold along every order, and far below it when a
+    // join attribute is a key or has a low degree.
+    double DegreeBound();
 
     std::vector<double> EdgeLogWeight() const;
 
@@ -41,4 +74,70 @@ private:
 private:
     const std::vector<RelationRef>& mRelations;
     const std::vector<std::string>& mAttrs;
-};
\ No newline at end of file
+    EstimateModel mModel;
+
+    static inline std::string sDefaultSolver = "BUILTIN";
+};
+
+// Estimates shared by every optimizer of a run, the AGM ones from the default solver. The
+// optimizers estimate the same subsets of a query over and over: per candidate attribute and its
+// recursion, per DP level and per cut candidate. A subset is keyed by the model and two bitmasks,
+// of its relations' positions in the bound relation list and of its attributes' positions in the
+// bound attribute list, so a lookup neither sorts nor allocates. Queries with more than 64
+// relations or attributes, and relations outside the bound list, are estimated without the cache.
+// Loaded estimates are keyed by the model, the relation names and lengths and the attribute names,
+// which stay valid for every query over the same database. The optimizers run on one thread.
+class EstimateCache
+{
+public:
+    static EstimateCache& Shared();
+
+    // Keys later lookups by positions in these lists; binding the same lists again keeps the entries
+    void Bind(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs);
+
+    double Estimate(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, EstimateModel model, const std::function<double()>& estimate);
+
+    // Adds the estimates saved in path, if it exists, and saves them with the new ones on Save()
+    void Load(const std::string& path);
+
+    void Save() const;
+
+    size_t Hits() const { return mHits; }
+
+    // estimates computed, i.e. found neither in the cache nor in the loaded file
+    size_t Misses() const { return mMisses; }
+
+    size_t Loaded() const { return mLoaded; }
+
+private:
+    struct Key
+    {
+        uint64_t relations;
+        uint64_t attrs;
+        EstimateModel model;
+
+        bool operator==(const Key& other) const { return relations == other.relations and attrs == other.attrs and model == other.model; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return std::hash<uint64_t>()((key.relations * 0x9e3779b97f4a7c15ULL ^ key.attrs) * 2 + size_t(key.model)); }
+    };
+
+    bool MakeKey(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, Key& key) const;
+
+    // "model name:length,... attr,..." with the relations and the attributes sorted
+    static std::string PersistentKey(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, EstimateModel model);
+
+private:
+    std::unordered_map<const Relation*, size_t> mRelationBits;
+    std::unordered_map<std::string, size_t> mAttrBits;
+    std::unordered_map<Key, double, KeyHash> mEstimates;
+
+    std::string mPath;
+    std::unordered_map<std::string, double> mSaved;
+
+    size_t mHits = 0;
+    size_t mMisses = 0;
+    size_t mLoaded = 0;
+};
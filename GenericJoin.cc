@@ -1,9 +1,18 @@
 #include "GenericJoin.h"
+#include "HashIndex.h"
+#include "Interleave.h"
+#include "Intersection.h"
+#include "JoinKernels.h"
 #include "Range.h"
 #include "Timer.h"
 
+#include <algorithm>
+#include <bit>
 #include <iostream>
 #include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
 #include <vector>
 
 
@@ -12,6 +21,16 @@ namespace
 
 constexpr bool Debug = false;
 
+// key partitions of the parallel loop join per worker, and samples drawn per partition
+constexpr size_t PartitionsPerThread = 4;
+constexpr size_t SamplesPerPartition = 8;
+
+// probes collected per round of the interleaved modes
+constexpr size_t ProbeChunkSize = 256;
+
+// groups of an aggregation printed after the join
+constexpr size_t PrintedGroupNum = 10;
+
 RangeTable CreateEstimatedRangeTable(RangeTable& table, std::vector<size_t>& relIndices, size_t relTotalNum, double cost)
 {
     size_t estimatedTuple = 0;
@@ -48,6 +67,229 @@ RangeTable CreateFullEstimatedRangeTable(std::vector<RangeTableRef>& tableRefs,
 
 
 
+// Lexicographic comparison of two composite keys of width ints
+inline int CompareKeys(const int* key1, const int* key2, size_t width)
+{
+    for (size_t i = 0; i < width; i++)
+        if (key1[i] != key2[i])
+            return key1[i] < key2[i] ? -1 : 1;
+    return 0;
+}
+
+// Exponential search over packed composite keys of width ints sorted lexicographically. Returns
+// the first index in [fromIndex, endIndex) whose key is not less than key, or greater than key
+// when upper is set.
+size_t GallopKeys(const std::vector<int>& keys, size_t width, size_t fromIndex, size_t endIndex, const int* key, bool upper)
+{
+    auto before = [&](size_t index){
+        int cmp = CompareKeys(keys.data() + index * width, key, width);
+        return upper ? cmp <= 0 : cmp < 0;
+    };
+
+    size_t lo = fromIndex, hi = fromIndex, step = 1;
+    while (hi < endIndex and before(hi))
+    {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    hi = std::min(hi, endIndex);
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (before(mid))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+
+// Branchless lower (or upper) bounds of count values in column[st, ed). All searches share the
+// range, so they advance in lockstep one level at a time: the loads of a level are independent
+// and overlap, and every search prefetches its probe of the next level.
+void BatchBound(const int* column, size_t st, size_t ed, const int* values, size_t count, bool upper, size_t* out)
+{
+    for (size_t b = 0; b < count; b++)
+        out[b] = st;
+    if (st == ed)
+        return;
+
+    size_t n = ed - st;
+    while (n > 1)
+    {
+        size_t half = n / 2;
+        size_t nextHalf = (n - half) / 2;
+        for (size_t b = 0; b < count; b++)
+        {
+            int probe = column[out[b] + half];
+            bool right = upper ? probe <= values[b] : probe < values[b];
+            out[b] += right ? half : 0;
+            __builtin_prefetch(column + out[b] + nextHalf);
+        }
+        n -= half;
+    }
+
+    for (size_t b = 0; b < count; b++)
+    {
+        int probe = column[out[b]];
+        out[b] += upper ? probe <= values[b] : probe < values[b];
+    }
+}
+
+// Looks value up in the participating ranges of tuple, writing its run in every range to out, or
+// an empty out[0] if one range lacks it. Each step of the searches prefetches the value it
+// compares and suspends.
+ProbeTask ProbeRanges(RangeTuple tuple, const size_t* relationIndices, const int* const* columns, size_t relNum, int value, Range* out)
+{
+    for (size_t i = 0; i < relNum; i++)
+    {
+        Range range = tuple[relationIndices[i]];
+        const int* column = columns[i];
+
+        size_t bounds[2];
+        for (size_t upper = 0; upper < 2; upper++)
+        {
+            size_t base = upper ? bounds[0] : range.st;
+            size_t n = range.ed - base;
+            while (n > 0)
+            {
+                size_t half = n / 2;
+                co_await Prefetch{column + base + half};
+                bool right = upper ? column[base + half] <= value : column[base + half] < value;
+                base = right ? base + half + 1 : base;
+                n = right ? n - half - 1 : half;
+            }
+            bounds[upper] = base;
+        }
+
+        if (bounds[0] == bounds[1])
+        {
+            out[0] = Range{0, 0};
+            co_return;
+        }
+        out[i] = Range{bounds[0], bounds[1]};
+    }
+}
+
+// A range table sorted by the tracked attribute, searched through its sort index
+struct SortedTableProbe
+{
+    const size_t* sortIndex;
+    size_t length;
+    RangeTable* table;
+    size_t trackedRelId;
+    const int* column;
+};
+
+// Looks value up in every sorted table, writing its run of sort positions to out, or an empty
+// out[0] if one table lacks it. Every comparison chases sort index, range tuple and attribute
+// value, so each of the three loads is prefetched before suspending.
+ProbeTask ProbeSortedTables(const SortedTableProbe* tables, size_t tableNum, int value, Range* out)
+{
+    for (size_t tableId = 0; tableId < tableNum; tableId++)
+    {
+        const SortedTableProbe& probe = tables[tableId];
+
+        size_t bounds[2];
+        for (size_t upper = 0; upper < 2; upper++)
+        {
+            size_t base = upper ? bounds[0] : 0;
+            size_t n = probe.length - base;
+            while (n > 0)
+            {
+                size_t half = n / 2;
+                co_await Prefetch{probe.sortIndex + base + half};
+                RangeTuple rangeTuple = (*probe.table)[probe.sortIndex[base + half]];
+                co_await Prefetch{rangeTuple + probe.trackedRelId};
+                const int* cell = probe.column + rangeTuple[probe.trackedRelId].st;
+                co_await Prefetch{cell};
+
+                bool right = upper ? *cell <= value : *cell < value;
+                base = right ? base + half + 1 : base;
+                n = right ? n - half - 1 : half;
+            }
+            bounds[upper] = base;
+        }
+
+        if (bounds[0] == bounds[1])
+        {
+            out[0] = Range{0, 0};
+            co_return;
+        }
+        out[tableId] = Range{bounds[0], bounds[1]};
+    }
+}
+
+// Looks the composite key of a join relation run up in the hash index of every sub-table, the
+// key of table t starting at key + keyOffsets[t]. Writes an empty out[0] on the first miss.
+ProbeTask ProbeKeyIndices(const CompositeKeyIndex* keyIndices, const size_t* keyOffsets, size_t tableNum, const int* key, Range* out)
+{
+    for (size_t tableId = 0; tableId < tableNum; tableId++)
+    {
+        const int* tableKey = key + keyOffsets[tableId];
+        keyIndices[tableId].PrefetchSlot(tableKey);
+        co_await std::suspend_always{};
+        keyIndices[tableId].PrefetchEntry(tableKey);
+        co_await std::suspend_always{};
+
+        const Range* matches = keyIndices[tableId].Find(tableKey);
+        if (matches == nullptr)
+        {
+            out[0] = Range{0, 0};
+            co_return;
+        }
+        out[tableId] = *matches;
+    }
+}
+
+// Flags the tuples of target whose values on attrs occur in some tuple of source. One attribute
+// is probed in a bitmap of the distinct source values, composite keys in a hash index.
+std::vector<bool> SemiJoinMask(Relation& target, Relation& source, const std::vector<std::string>& attrs)
+{
+    std::vector<bool> keep(target.Length());
+    if (attrs.size() == 1)
+    {
+        std::vector<int> values = source[attrs[0]].get().Raw();
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        RoaringBitmap bitmap(values.data(), values.size());
+
+        auto& column = target[attrs[0]].get();
+        for (size_t i = 0; i < target.Length(); i++)
+            keep[i] = bitmap.Contains(column[i]);
+        return keep;
+    }
+
+    const size_t keyWidth = attrs.size();
+    std::vector<AttributeRef<int>> sourceColumns, targetColumns;
+    for (auto& attr : attrs)
+    {
+        sourceColumns.emplace_back(source[attr]);
+        targetColumns.emplace_back(target[attr]);
+    }
+
+    CompositeKeyIndex index(keyWidth, source.Length());
+    std::vector<int> key(keyWidth);
+    for (size_t i = 0; i < source.Length(); i++)
+    {
+        for (size_t k = 0; k < keyWidth; k++)
+            key[k] = sourceColumns[k].get()[i];
+        index.Insert(key.data(), Range{i, i + 1});
+    }
+
+    for (size_t i = 0; i < target.Length(); i++)
+    {
+        for (size_t k = 0; k < keyWidth; k++)
+            key[k] = targetColumns[k].get()[i];
+        keep[i] = index.Find(key.data()) != nullptr;
+    }
+    return keep;
+}
+
 RangeTableIterator CreateRangeTableIter(const std::vector<RangeTableRef>& tableRefs)
 {
     std::vector<size_t> tableLength(tableRefs.size());
@@ -136,14 +378,28 @@ void GenericJoin::PrintEqTable(RangeTable& rangeTable, const std::vector<std::st
     }
 }
 
-RangeTable GenericJoin::ExecuteCartesian(std::unique_ptr<LTPlan> plan)
+// Sibling sub-plans share no intermediate results, so they run as tasks of the join's pool.
+// Their own parallel operators are nested into the same pool instead of starting more threads.
+std::vector<RangeTable> GenericJoin::ExecuteSubPlans(std::vector<std::unique_ptr<LTPlan>>&& subPlans)
 {
     std::vector<RangeTable> subRangeTables;
+    for (size_t i = 0; i < subPlans.size(); i++)
+        subRangeTables.emplace_back(mRelations.size(), 0);
+
+    ThreadPool::TaskGroup group(*mPool);
+    for (size_t i = 0; i < subPlans.size(); i++)
+        group.Run([&, i]{ subRangeTables[i] = Execute(std::move(subPlans[i])); });
+    group.Wait();
+
+    return subRangeTables;
+}
+
+RangeTable GenericJoin::ExecuteCartesian(std::unique_ptr<LTPlan> plan)
+{
+    std::vector<std::unique_ptr<LTPlan>> subPlans;
     for (size_t i = 0; i < plan->SubPlanNum(); i++)
-    {
-        auto subPlan = plan->NextSubPlan();
-        subRangeTables.push_back(Execute(std::move(subPlan)));
-    }
+        subPlans.emplace_back(plan->NextSubPlan());
+    std::vector<RangeTable> subRangeTables = ExecuteSubPlans(std::move(subPlans));
 
     std::vector<RangeTableRef> subRangeTableRefs{subRangeTables.begin(), subRangeTables.end()};
 
@@ -156,12 +412,10 @@ RangeTable GenericJoin::ExecuteMuti(std::unique_ptr<LTPlan> plan)
     // std::cout << "    attr: " << plan->GetAttr() << std::endl;
     // std::cout << "    subplan num: " << plan->SubPlanNum() << std::endl;
 
-    std::vector<RangeTable> subRangeTables;
+    std::vector<std::unique_ptr<LTPlan>> subPlans;
     for (int i = plan->SubPlanNum() - 1; i >= 0; i--)
-    {
-        auto subPlan = plan->NextSubPlan();
-        subRangeTables.push_back(Execute(std::move(subPlan)));
-    }
+        subPlans.emplace_back(plan->NextSubPlan());
+    std::vector<RangeTable> subRangeTables = ExecuteSubPlans(std::move(subPlans));
 
     std::vector<RangeTableRef> subRangeTableRefs{subRangeTables.begin(), subRangeTables.end()};
 
@@ -200,44 +454,43 @@ RangeTable GenericJoin::ExecuteSingle(std::unique_ptr<LTPlan> plan)
     return SingleAttrWCOJoin(subRangeTable, plan->GetRelationIndices(), plan->GetAttr(), plan->cost);
 }
 
-RangeTable GenericJoin::ExecuteEH(std::unique_ptr<LTPlan> plan)
+RangeTable GenericJoin::ExecuteEH(std::unique_ptr<LTPlan> plan, const EHRunVisitor& visitRun)
 {
     EHPlan* ehPlan = dynamic_cast<EHPlan*>(plan.get());
 
-    std::vector<RangeTable> subRangeTables;
+    std::vector<std::unique_ptr<LTPlan>> subPlans;
     std::vector<std::vector<std::string>> attrList;
     for (int i = ehPlan->SubPlanNum() - 1; i >= 0; i--)
     {
         auto&& [subPlan, atts] = ehPlan->EHNextSubPlan();
         attrList.emplace_back(atts);
-        subRangeTables.push_back(Execute(std::move(subPlan)));
+        subPlans.emplace_back(std::move(subPlan));
     }
 
+    std::vector<RangeTable> subRangeTables = ExecuteSubPlans(std::move(subPlans));
+
     // sort each range table
-    std::vector<std::vector<size_t>> sortIndicesVec;
-    for (size_t i = 0; i < subRangeTables.size(); i++)
+    std::vector<std::vector<size_t>> sortIndicesVec(subRangeTables.size());
     {
-        std::vector<size_t> mapRelationIndices;
-        for (auto& attr : attrList[i])
+        ThreadPool::TaskGroup group(*mPool);
+        for (size_t i = 0; i < subRangeTables.size(); i++)
         {
-            for (auto& relId : subRangeTables[i].GetRelIndices())
-                if (mRelations[relId].ExistAttr(attr))
+            group.Run([&, i]{
+                std::vector<size_t> mapRelationIndices;
+                for (auto& attr : attrList[i])
                 {
-                    mapRelationIndices.push_back(relId);
-                    break;
+                    for (auto& relId : subRangeTables[i].GetRelIndices())
+                        if (mRelations[relId].ExistAttr(attr))
+                        {
+                            mapRelationIndices.push_back(relId);
+                            break;
+                        }
                 }
-        }
 
-        sortIndicesVec.emplace_back(subRangeTables[i].LazySort(mRelations, mapRelationIndices, attrList[i]));
-        // for(auto ind : sortIndicesVec.back())
-        // {
-            // RangeTuple tuple = subRangeTables[i][ind];
-            // Range rng = tuple[mapRelationIndices[0]];
-            // size_t st = rng.st;
-            // std::cout << "Indi: " << ind << ' ' << mRelations[mapRelationIndices[i]][attrList[i][0]].get()[st];
-            // std::cout << std::endl;
-        // }
-        // std::cout << std::endl;
+                sortIndicesVec[i] = subRangeTables[i].LazySort(mRelations, mapRelationIndices, attrList[i]);
+            });
+        }
+        group.Wait();
     }
 
     // table: attribute to relation id
@@ -261,6 +514,57 @@ RangeTable GenericJoin::ExecuteEH(std::unique_ptr<LTPlan> plan)
         tableAttr2RelIdMapVec.emplace_back(attr2RelIdMap);
     }
 
+    // composite join keys of every sub-table in sorted order, attrList[tableId].size() ints per tuple
+    std::vector<std::vector<int>> sortedKeys(subRangeTables.size());
+    std::vector<std::vector<size_t>> tableRelIds(subRangeTables.size());
+    std::vector<CompositeKeyIndex> keyIndices;
+    if (mOptions.ehMerge == EHMergeMode::Hash)
+        for (size_t tableId = 0; tableId < subRangeTables.size(); tableId++)
+            keyIndices.emplace_back(attrList[tableId].size());
+    {
+        ThreadPool::TaskGroup group(*mPool);
+        for (size_t tableId = 0; tableId < subRangeTables.size(); tableId++)
+        {
+            group.Run([&, tableId]{
+                auto& table = subRangeTables[tableId];
+                auto& sortIndices = sortIndicesVec[tableId];
+                const size_t keyWidth = attrList[tableId].size();
+                tableRelIds[tableId].assign(table.GetRelIndices().begin(), table.GetRelIndices().end());
+
+                std::vector<size_t> relIds;
+                std::vector<AttributeRef<int>> columns;
+                for (auto& attr : attrList[tableId])
+                {
+                    relIds.push_back(tableAttr2RelIdMapVec[tableId].at(attr));
+                    columns.emplace_back(mRelations[relIds.back()][attr]);
+                }
+
+                auto& keys = sortedKeys[tableId];
+                keys.resize(sortIndices.size() * keyWidth);
+                for (size_t seq = 0; seq < sortIndices.size(); seq++)
+                {
+                    RangeTuple rangeTuple = table[sortIndices[seq]];
+                    for (size_t i = 0; i < keyWidth; i++)
+                        keys[seq * keyWidth + i] = columns[i].get()[rangeTuple[relIds[i]].st];
+                }
+
+                // hash indexes from each composite key to its run in sorted order
+                if (keyIndices.empty())
+                    return;
+                size_t runSt = 0;
+                for (size_t seq = 1; seq <= sortIndices.size(); seq++)
+                {
+                    if (seq == sortIndices.size() or CompareKeys(&keys[seq * keyWidth], &keys[runSt * keyWidth], keyWidth) != 0)
+                    {
+                        keyIndices[tableId].Insert(keys.data() + runSt * keyWidth, Range{runSt, seq});
+                        runSt = seq;
+                    }
+                }
+            });
+        }
+        group.Wait();
+    }
+
     // sort relation
     auto& joinRelation = mRelations[ehPlan->mRelationId];
     std::vector<std::string> attrSortSeq;
@@ -269,151 +573,200 @@ RangeTable GenericJoin::ExecuteEH(std::unique_ptr<LTPlan> plan)
             for (auto& att : atts)
                 attrSortSeq.push_back(att);
         joinRelation.Sort(attrSortSeq);
+        if (mOptions.searchIndexThreshold > 0)
+            BuildSearchIndexes(joinRelation);
     }
 
     std::vector<RangeTableRef> tableRefs;
     for (auto& table : subRangeTables)
         tableRefs.emplace_back(table);
-    RangeTable nextRangeTable = CreateFullEstimatedRangeTable(tableRefs, mRelations.size(), plan->cost);
-    std::vector<Range> rangeRange(subRangeTables.size());
 
-    // merge
-    size_t joinAttrNum = 0;
-    for (auto& attVec : attrList)
-        joinAttrNum += attVec.size();
-    std::vector<int> preValue(joinAttrNum);
-    std::fill(preValue.begin(), preValue.end(), -1);
+    const size_t tableNum = subRangeTables.size();
+    const size_t joinAttrNum = attrSortSeq.size();
+    std::vector<AttributeRef<int>> keyColumns;
+    for (auto& att : attrSortSeq)
+        keyColumns.emplace_back(joinRelation[att]);
+    std::vector<size_t> keyOffsets(tableNum + 1, 0);
+    for (size_t tableId = 0; tableId < tableNum; tableId++)
+        keyOffsets[tableId + 1] = keyOffsets[tableId] + attrList[tableId].size();
+
+    auto sameKey = [&](size_t id1, size_t id2){
+        for (auto& column : keyColumns)
+            if (column.get()[id1] != column.get()[id2])
+                return false;
+        return true;
+    };
 
-    for (size_t jrTupleId = 0; jrTupleId < joinRelation.Length(); jrTupleId++)
-    {
-        std::vector<int> currentValue;
-        for (auto& attVec : attrList)
-            for (auto& att : attVec)
-                currentValue.push_back(joinRelation[att].get()[jrTupleId]);
+    // emit the cartesian product of the matching runs of the sub-tables, last table fastest
+    auto emitRun = [&](size_t jrTupleId, size_t jrRunEd, const Range* rangeRange, std::vector<size_t>& positions, RangeTable& nextRangeTable){
+        if (visitRun)
         {
-            bool dup = true;
-            for (size_t i = 0; i < joinAttrNum; i++)
-                if (preValue[i] != currentValue[i])
-                {
-                    dup = false;
+            visitRun(jrTupleId, rangeRange, tableNum);
+            return;
+        }
+
+        for (size_t tableId = 0; tableId < tableNum; tableId++)
+            positions[tableId] = rangeRange[tableId].st;
+
+        while (true)
+        {
+            RangeTuple tuple = nextRangeTable.AcquireTuple();
+            tuple[ehPlan->mRelationId] = Range{jrTupleId, jrRunEd};
+            for (size_t tableId = 0; tableId < tableNum; tableId++)
+            {
+                RangeTuple rangeTuple = subRangeTables[tableId][sortIndicesVec[tableId][positions[tableId]]];
+                for (size_t relId : tableRelIds[tableId])
+                    tuple[relId] = rangeTuple[relId];
+            }
+
+            size_t tableId = tableNum;
+            while (tableId > 0)
+            {
+                if (++positions[tableId - 1] < rangeRange[tableId - 1].ed)
                     break;
-                }
-            if (dup)
+                positions[tableId - 1] = rangeRange[tableId - 1].st;
+                tableId--;
+            }
+            if (tableId == 0)
                 break;
         }
-        // std::cout << "Current value: ";
-        // for(int value : currentValue) std::cout << value << ' ';
-        // std::cout << std::endl;
-
-        bool valid = true;
-        size_t joinAttrOff = 0;
-        for (size_t tableId = 0; tableId < subRangeTables.size(); tableId++)
+    };
+
+    // Merge the join relation tuples in [jrSt, jrEd) with the sorted sub-tables, one run of equal
+    // composite keys at a time. The key of a sub-table only decreases when the key of an earlier
+    // table changed, so its cursor moves forward with exponential search and restarts only then.
+    auto merge = [&](size_t jrSt, size_t jrEd, RangeTable& nextRangeTable){
+        std::vector<int> currentValue(joinAttrNum);
+        std::vector<int> cursorKeys(joinAttrNum);
+        std::vector<size_t> cursors(tableNum, 0);
+        std::vector<size_t> positions(tableNum);
+        std::vector<Range> rangeRange(tableNum);
+
+        size_t jrTupleId = jrSt;
+        while (jrTupleId < jrEd)
         {
-            auto& table = subRangeTables[tableId];
-            std::vector<int> targetValue(attrList[tableId].size());
-            for (size_t i = 0; i < attrList[tableId].size(); i++)
-                targetValue[i] = currentValue[i + joinAttrOff];
-            joinAttrOff += attrList[tableId].size();
-
-            // std::cout << "target value: ";
-            // for (int value : targetValue) std::cout << value << ' ';
-            // std::cout << std::endl;
-
-            // table->rtupleId->attId
-            auto converter = [&](size_t rtupleId, size_t relId, std::string& attr){
-                size_t st = table[rtupleId][relId].st;
-                int storeValue = this->mRelations[relId][attr].get()[st];
-                return storeValue;
-            };
+            for (size_t i = 0; i < joinAttrNum; i++)
+                currentValue[i] = keyColumns[i].get()[jrTupleId];
 
-            // std::cout << "order seq: " << std::endl;
-            // for (int value : sortIndicesVec[tableId]) std::cout << value << ' ';
-            // std::cout << std::endl;
-            // std::string testattr = attrList[tableId][0];
-            // size_t testRelId = tableAttr2RelIdMapVec[tableId][testattr];
-            // std::cout << "test converter: " << std::endl;
-            // for (size_t i = 0; i < table.Length(); i++)
-            //     std::cout << converter(sortIndicesVec[tableId][i], testRelId, testattr) << ' ';
-            // std::cout << std::endl;
-            
-            auto finderLow = [&](size_t tupleId, const std::vector<int>& valueTuple){
-                RangeTuple rangeTuple = table[tupleId];
-                for (size_t i = 0; i < attrList[tableId].size(); i++)
-                {
-                    auto& attr = attrList[tableId][i];
-                    size_t relId = tableAttr2RelIdMapVec[tableId][attr];
-                    int storeValue = converter(tupleId, relId, attr);
-                    if (storeValue != valueTuple[i])
-                        return storeValue < valueTuple[i];
-                }
-                return false;
-            };
+            size_t jrRunEd = jrTupleId + 1;
+            while (jrRunEd < jrEd and sameKey(jrTupleId, jrRunEd))
+                jrRunEd++;
+
+            bool valid = true;
+            for (size_t tableId = 0; tableId < tableNum and valid; tableId++)
+            {
+                const int* key = currentValue.data() + keyOffsets[tableId];
+                const size_t keyWidth = attrList[tableId].size();
 
-            auto finderUp = [&](const std::vector<int>& valueTuple, size_t tupleId){
-                for (size_t i = 0; i < attrList[tableId].size(); i++)
+                if (!keyIndices.empty())
                 {
-                    auto& attr = attrList[tableId][i];
-                    size_t relId = tableAttr2RelIdMapVec[tableId][attr];
-                    int storeValue = converter(tupleId, relId, attr);
-                    if (storeValue != valueTuple[i])
-                        return storeValue > valueTuple[i];
+                    const Range* matches = keyIndices[tableId].Find(key);
+                    valid = matches != nullptr;
+                    if (valid)
+                        rangeRange[tableId] = *matches;
+                    continue;
                 }
-                return false;
-            };
 
-            auto& sortIndices = sortIndicesVec[tableId];
-            auto lowerIndex = std::lower_bound(sortIndices.begin(), sortIndices.end(), targetValue, finderLow) - sortIndices.begin();
-            auto upperIndex = std::upper_bound(sortIndices.begin(), sortIndices.end(), targetValue, finderUp) - sortIndices.begin();
+                int* cursorKey = cursorKeys.data() + keyOffsets[tableId];
+                if (cursors[tableId] > 0 and CompareKeys(key, cursorKey, keyWidth) < 0)
+                    cursors[tableId] = 0;
 
-            if (lowerIndex >= upperIndex)
-            {
-                valid = false;
-                break;
+                auto& keys = sortedKeys[tableId];
+                const size_t length = sortIndicesVec[tableId].size();
+                size_t lower = GallopKeys(keys, keyWidth, cursors[tableId], length, key, false);
+                cursors[tableId] = lower;
+                std::copy(key, key + keyWidth, cursorKey);
+
+                valid = lower < length and CompareKeys(&keys[lower * keyWidth], key, keyWidth) == 0;
+                if (valid)
+                    rangeRange[tableId] = Range{lower, GallopKeys(keys, keyWidth, lower, length, key, true)};
             }
 
-            rangeRange[tableId].st = lowerIndex;
-            rangeRange[tableId].ed = upperIndex;
-            // std::cout << "(" << lowerIndex << ", " << upperIndex << ")  " << std::endl;
+            if (valid)
+                emitRun(jrTupleId, jrRunEd, rangeRange.data(), positions, nextRangeTable);
+
+            jrTupleId = jrRunEd;
         }
-        // std::cout << std::endl;
+    };
 
-        if (valid)
+    // The hash lookups of up to ProbeChunkSize runs at a time as interleaved ProbeKeyIndices coroutines
+    auto probeMerge = [&](size_t jrSt, size_t jrEd, RangeTable& nextRangeTable){
+        std::vector<int> keys(ProbeChunkSize * joinAttrNum);
+        std::vector<size_t> runBounds(ProbeChunkSize + 1);
+        std::vector<Range> ranges(ProbeChunkSize * tableNum);
+        std::vector<size_t> positions(tableNum);
+
+        size_t jrTupleId = jrSt;
+        while (jrTupleId < jrEd)
         {
-            RangeVecIterator iter(rangeRange);
-            while (iter)
+            size_t count = 0;
+            runBounds[0] = jrTupleId;
+            for (; jrTupleId < jrEd and count < ProbeChunkSize; count++)
             {
-                auto rangeVec = iter.Get();
-                auto tuple = nextRangeTable.AcquireTuple();
-
-                {
-                    size_t st = 0;
-                    size_t ed = joinRelation.Length();
+                for (size_t i = 0; i < joinAttrNum; i++)
+                    keys[count * joinAttrNum + i] = keyColumns[i].get()[jrTupleId];
 
-                    for (size_t attrSeq = 0; attrSeq < attrSortSeq.size(); attrSeq++)
-                    {
-                        auto& attr = attrSortSeq[attrSeq];
-                        auto& attrData = joinRelation[attr].get();
-                        int expectedValue = currentValue[attrSeq];
-                        st = std::lower_bound(attrData.Raw().begin(), attrData.Raw().end(), expectedValue) - attrData.Raw().begin();
-                        ed = std::upper_bound(attrData.Raw().begin(), attrData.Raw().end(), expectedValue) - attrData.Raw().begin();
-                    }
+                size_t jrRunEd = jrTupleId + 1;
+                while (jrRunEd < jrEd and sameKey(jrTupleId, jrRunEd))
+                    jrRunEd++;
+                runBounds[count + 1] = jrTupleId = jrRunEd;
+            }
 
-                    tuple[ehPlan->mRelationId] = {st, ed};
-                }
+            Interleave(count, mOptions.interleave, [&](size_t b){
+                return ProbeKeyIndices(keyIndices.data(), keyOffsets.data(), tableNum, keys.data() + b * joinAttrNum, ranges.data() + b * tableNum);
+            });
 
-                for (size_t tableIndex = 0; tableIndex < tableRefs.size(); tableIndex++)
-                {
-                    auto& table = tableRefs[tableIndex].get();
-                    RangeTuple rangetuple = table[sortIndicesVec[tableIndex][rangeVec[tableIndex]]];
-                    for (auto relId : table.GetRelIndices())
-                        tuple[relId] = rangetuple[relId];
-                }
-                iter++;
-            }
+            for (size_t b = 0; b < count; b++)
+                if (ranges[b * tableNum].Valid())
+                    emitRun(runBounds[b], runBounds[b + 1], ranges.data() + b * tableNum, positions, nextRangeTable);
         }
+    };
+
+    const bool interleaved = !keyIndices.empty() and mOptions.interleave > 0;
+    auto run = [&](size_t jrSt, size_t jrEd, RangeTable& nextRangeTable){
+        if (interleaved)
+            probeMerge(jrSt, jrEd, nextRangeTable);
+        else
+            merge(jrSt, jrEd, nextRangeTable);
+    };
+
+    const size_t jrLength = joinRelation.Length();
+    if (mPool->ThreadNum() == 1 or jrLength <= mOptions.morselSize)
+    {
+        RangeTable nextRangeTable = CreateFullEstimatedRangeTable(tableRefs, mRelations.size(), plan->cost);
+        run(0, jrLength, nextRangeTable);
+        return nextRangeTable;
+    }
 
-        preValue = currentValue;
+    // cut the sorted join relation into partitions that never split a composite key
+    const size_t partitionNum = mPool->ThreadNum() * PartitionsPerThread;
+    std::vector<size_t> bounds{0};
+    for (size_t partition = 1; partition < partitionNum; partition++)
+    {
+        size_t bound = std::max(bounds.back(), partition * jrLength / partitionNum);
+        while (bound > 0 and bound < jrLength and sameKey(bound - 1, bound))
+            bound++;
+        if (bound > bounds.back() and bound < jrLength)
+            bounds.push_back(bound);
     }
+    bounds.push_back(jrLength);
+
+    std::vector<RangeTable> chunks;
+    for (size_t partition = 0; partition + 1 < bounds.size(); partition++)
+        chunks.emplace_back(mRelations.size(), 0);
+
+    mPool->ParallelFor(chunks.size(), 1, [&](size_t, size_t st, size_t ed){
+        for (size_t partition = st; partition < ed; partition++)
+            run(bounds[partition], bounds[partition + 1], chunks[partition]);
+    });
+
+    size_t resultNum = 0;
+    for (auto& chunk : chunks)
+        resultNum += chunk.Length();
+
+    RangeTable nextRangeTable(mRelations.size(), resultNum);
+    for (auto& chunk : chunks)
+        nextRangeTable.Append(chunk);
 
     return nextRangeTable;
 }
@@ -429,91 +782,540 @@ RangeTable GenericJoin::Execute(std::unique_ptr<LTPlan> plan)
 }
 
 
-Relation GenericJoin::operator()()
+// Search indexes are built before execution, or right after a relation is re-sorted, so that no
+// operator queries an attribute while its index is being built.
+void GenericJoin::BuildSearchIndexes(Relation& relation)
 {
-    auto rangeTable = Execute(std::move(mPlan));
+    for (auto& [attr, data] : relation.Attrs())
+        relation[attr].get().BuildSearchIndex(mOptions.searchIndexThreshold);
+}
 
-    std::cout << "Join results number: " << rangeTable.Length() << std::endl;
-    // rangeTable.Print();
 
-    // Convert range table to relation
-    Relation result;
-    /*
-    for (size_t attrIndex = 0; attrIndex < rangeTable.Width(); attrIndex++)
-    {
-        std::string attrName = mAttrs[attrIndex];
-        std::vector<int> attrData(rangeTable.Length());
+// Semi-join reduction in the spirit of Yannakakis over the star that every EH plan forms: the cut
+// relation in the middle and, around it, the relations of each sub-plan that share join
+// attributes with it. The cut relation is first reduced by all of them, then each of them by the
+// reduced cut relation, so the sub-plans only see tuples that meet a cut tuple. The relations are
+// filtered in place before any operator reads them; their sort order is kept.
+void GenericJoin::SemiJoinReduce(LTPlan& plan)
+{
+    for (LTPlan* subPlan : plan.SubPlans())
+        SemiJoinReduce(*subPlan);
+    if (!plan.IsEH())
+        return;
 
-        for (auto& rel : mRelations)
-            if (rel.ExistAttr(attrName))
-            {
-                const auto& attr = rel[attrName];
-                for (size_t tupleIndex = 0; tupleIndex < rangeTable.Length(); tupleIndex++)
-                {
-                    RangeTuple rangeTuple = rangeTable[tupleIndex];
-                    int value = attr[rangeTuple[attrIndex].st];
-                    attrData[tupleIndex] = value;
-                }
+    EHPlan& ehPlan = dynamic_cast<EHPlan&>(plan);
+    auto& cutRelation = mRelations[ehPlan.mRelationId];
 
-                break;
-            }
+    // relations around the cut relation with the join attributes they share with it
+    std::vector<std::pair<size_t, std::vector<std::string>>> neighbours;
+    for (size_t relId = 0; relId < mRelations.size(); relId++)
+    {
+        if (relId == ehPlan.mRelationId)
+            continue;
 
-        result.SetTupleNum(attrData.size());
-        result.Insert(attrName, std::move(attrData));
+        std::vector<std::string> shared;
+        for (auto& [subPlan, attrs] : ehPlan.mNextPlan)
+            for (auto& attr : attrs)
+                if (mRelations[relId].ExistAttr(attr))
+                    shared.push_back(attr);
+        if (!shared.empty())
+            neighbours.emplace_back(relId, std::move(shared));
     }
 
-    std::cout << "Final result: " << result.Length() <<std::endl;
-    */
+    std::vector<size_t> lengths;
+    for (auto& [relId, attrs] : neighbours)
+        lengths.push_back(mRelations[relId].Length());
+    const size_t cutLength = cutRelation.Length();
 
-    return result;
+    // cut relation semi-join every neighbour
+    std::vector<std::vector<bool>> masks(neighbours.size());
+    {
+        ThreadPool::TaskGroup group(*mPool);
+        for (size_t i = 0; i < neighbours.size(); i++)
+            group.Run([&, i]{ masks[i] = SemiJoinMask(cutRelation, mRelations[neighbours[i].first], neighbours[i].second); });
+        group.Wait();
+    }
+    std::vector<bool> keep(cutLength, true);
+    for (auto& mask : masks)
+        for (size_t i = 0; i < cutLength; i++)
+            keep[i] = keep[i] and mask[i];
+    cutRelation.Filter(keep);
 
-    /*
-    // create the primary range table
-    RangeTable rangeTable(mRelations.size(), 1);
+    // every neighbour semi-join the reduced cut relation
     {
-        RangeTuple tuple = rangeTable.AcquireTuple();
-        for (int i = 0; i < mRelations.size(); i++)
+        ThreadPool::TaskGroup group(*mPool);
+        for (auto& [relId, attrs] : neighbours)
+            group.Run([&, relId]{
+                auto& relation = mRelations[relId];
+                relation.Filter(SemiJoinMask(relation, cutRelation, attrs));
+            });
+        group.Wait();
+    }
+
+    if (mOptions.printStats)
+    {
+        std::string line = "Semi-join reduction around " + cutRelation.Name() + ": " + std::to_string(cutLength) + " -> " + std::to_string(cutRelation.Length());
+        for (size_t i = 0; i < neighbours.size(); i++)
         {
-            rangeTable[0][i].st = 0;
-            rangeTable[0][i].ed = mRelations[i].Length();
+            auto& relation = mRelations[neighbours[i].first];
+            line += ", " + relation.Name() + " " + std::to_string(lengths[i]) + " -> " + std::to_string(relation.Length());
         }
+        LogStats(line);
     }
+}
 
-    // for (const auto& attr : mPlan)
-    for (size_t attrIndexx = 0; attrIndexx < mPlan.size(); attrIndexx++)
+
+// Takes the chain of single-attribute WCO joins off the top of plan, outermost first, as long as
+// their attribute passes take. Returns what is left below them, nullptr if the chain reached the
+// bottom.
+std::unique_ptr<LTPlan> GenericJoin::PeelTopJoins(std::unique_ptr<LTPlan> plan, std::vector<std::unique_ptr<LTPlan>>& chain,
+                                                  const std::function<bool(const std::string&)>& take)
+{
+    while (plan and !plan->IsEH() and plan->SubPlanNum() <= 1 and take(plan->GetAttr()))
     {
-        const auto& attr = mPlan[attrIndexx];
+        std::unique_ptr<LTPlan> subPlan = plan->NextSubPlan();
+        chain.emplace_back(std::move(plan));
+        plan = std::move(subPlan);
+    }
+    return plan;
+}
 
-        if constexpr (Debug)
-        {
-            std::cout << std::endl << "Joining attribute " << attr << std::endl;
-            std::cout << "There exists " << rangeTable.Length() << " tuples in range table." << std::endl;
-        }
+// The input of a peeled chain: the result of the plan below it, or the tuple of full ranges
+RangeTable GenericJoin::ExecuteBelowPipeline(std::unique_ptr<LTPlan> plan)
+{
+    if (plan)
+        return Execute(std::move(plan));
 
-        if (rangeTable.Length() == 0)
+    RangeTable input(mRelations.size(), 1);
+    RangeTuple tuple = input.AcquireTuple();
+    for (size_t i = 0; i < mRelations.size(); i++)
+        tuple[i] = Range{0, mRelations[i].Length()};
+    return input;
+}
+
+// One level per joined attribute of chain, bottom-most first
+std::vector<GenericJoin::PipelineLevel> GenericJoin::PreparePipeline(std::vector<std::unique_ptr<LTPlan>>& chain)
+{
+    const size_t width = mRelations.size();
+    std::vector<PipelineLevel> levels(chain.size());
+    for (size_t depth = 0; depth < chain.size(); depth++)
+    {
+        LTPlan& levelPlan = *chain[chain.size() - 1 - depth];
+        PipelineLevel& level = levels[depth];
+        for (size_t i : levelPlan.GetRelationIndices())
+            if (mRelations[i].ExistAttr(levelPlan.GetAttr()))
+                level.relationIndices.push_back(i);
+        for (size_t i = 0; i < width; i++)
+            if (std::find(level.relationIndices.begin(), level.relationIndices.end(), i) == level.relationIndices.end())
+                level.relationIndicesC.push_back(i);
+        level.attrsData = FetchAttributes(level.relationIndices, levelPlan.GetAttr());
+        level.scratch = PrepareScratch(level.relationIndices, level.attrsData);
+        level.results = RangeTable(width, 0);
+    }
+    return levels;
+}
+
+// Replaces the results of level by the intersection of tuple on its attribute
+size_t GenericJoin::IntersectLevel(PipelineLevel& level, RangeTuple tuple, bool countOnly)
+{
+    level.results.Clear();
+    if (level.scratch.cache.Enabled())
+    {
+        // the counting level reads only the number of cached results
+        if (countOnly)
         {
-            if constexpr(Debug)
-                std::cout << "No range tuples left, stopping join." << std::endl;
-            break;
+            for (size_t i = 0; i < level.relationIndices.size(); i++)
+                level.scratch.cacheKey[i] = tuple[level.relationIndices[i]];
+            const Range* results = nullptr;
+            size_t resultNum = 0;
+            if (level.scratch.cache.Find(level.scratch.cacheKey.data(), results, resultNum))
+                return resultNum;
         }
+        else if (AppendCachedResults(tuple, level.relationIndices, level.scratch, level.results))
+            return level.results.Length();
+    }
 
-        auto relationIndices  = SelectRelationIndices(attr, true);
-        auto relationIndicesC = SelectRelationIndices(attr, false);
+    IntersectMode mode = mOptions.intersectMode;
+    if (mode == IntersectMode::Adaptive)
+        mode = SelectIntersectMode(tuple, level.relationIndices, level.attrsData);
 
-        auto attrsData = FetchAttributes(relationIndices, attr);
+    IntersectRangeTuple(mode, tuple, level.relationIndices, level.relationIndicesC, level.attrsData, level.scratch, level.results);
+    if (level.scratch.cache.Enabled() and !level.scratch.cache.Bypassed())
+        CacheResults(tuple, level.relationIndices, level.scratch, level.results, 0);
+    return level.results.Length();
+}
 
-        RangeTable nextRangeTable = CreateEstimatedRangeTable(rangeTable, relationIndices, mRelations.size());
 
-        for (size_t rangeTupleIndex = 0; rangeTupleIndex < rangeTable.Length(); rangeTupleIndex++)
-        {
-            RangeTuple rangeTuple = rangeTable[rangeTupleIndex];
-            size_t shortestRelationIndex = ShortestRangeIndex(rangeTuple, relationIndices);
+// LIMIT / EXISTS execution. The single-attribute WCO joins at the top of the plan run depth-first:
+// a range tuple is intersected at one level and every result is carried through the levels above
+// before the next one, so results appear before any level is complete and the join stops once
+// limit of them exist. A sub-plan below these joins is materialized as usual. Results come in
+// the order of the joined values, level by level, which is GVO order when the levels join the
+// GVO's last attributes in order; with ordered set, the sub-plan's tuples are sorted by the
+// GVO's first attributes so that the whole result is in GVO order.
+RangeTable GenericJoin::ExecutePipelined(std::unique_ptr<LTPlan> plan, size_t limit)
+{
+    std::vector<std::unique_ptr<LTPlan>> chain;
+    plan = PeelTopJoins(std::move(plan), chain, [](const std::string&){ return true; });
 
-            {
-                Range baseRange = rangeTuple[shortestRelationIndex];
-                auto baseAttr = mRelations[shortestRelationIndex][attr];
+    const size_t width = mRelations.size();
+    RangeTable input = ExecuteBelowPipeline(std::move(plan));
 
-                for (size_t attrIndex = baseRange.st; attrIndex < baseRange.ed; attrIndex++)
+    std::vector<size_t> inputOrder(input.Length());
+    std::iota(inputOrder.begin(), inputOrder.end(), 0);
+    if (mOptions.ordered)
+    {
+        const size_t boundNum = mOptions.gvo.size() - std::min(chain.size(), mOptions.gvo.size());
+        for (size_t depth = 0; depth < chain.size(); depth++)
+            if (boundNum + depth >= mOptions.gvo.size() or chain[chain.size() - 1 - depth]->GetAttr() != mOptions.gvo[boundNum + depth])
+                throw std::runtime_error("Ordered results need the top joins of the plan to follow the GVO");
+
+        std::vector<size_t> relIds;
+        std::vector<std::string> attrs;
+        for (size_t i = 0; i < boundNum; i++)
+        {
+            auto& attr = mOptions.gvo[i];
+            relIds.push_back(SelectRelationIndices(attr, true).front());
+            attrs.push_back(attr);
+        }
+        if (!attrs.empty() and input.Length() > 1)
+            inputOrder = input.LazySort(mRelations, relIds, attrs);
+    }
+
+    std::vector<PipelineLevel> levels = PreparePipeline(chain);
+
+    RangeTable result(width, std::min<size_t>(limit, 1024));
+    auto emit = [&](RangeTuple tuple){
+        std::copy_n(tuple, width, result.AcquireTuple());
+        return result.Length() < limit;
+    };
+
+    // false once the limit is reached
+    auto descend = [&](auto& self, RangeTuple tuple, size_t depth) -> bool {
+        if (depth == levels.size())
+            return emit(tuple);
+
+        PipelineLevel& level = levels[depth];
+        IntersectLevel(level, tuple);
+        for (size_t index = 0; index < level.results.Length(); index++)
+            if (!self(self, level.results[index], depth + 1))
+                return false;
+        return true;
+    };
+
+    for (size_t index : inputOrder)
+        if (!descend(descend, input[index], 0))
+            break;
+
+    return result;
+}
+
+
+// Group-by aggregation. Only the attributes that are grouped or aggregated need to be bound per
+// result: the WCO joins at the top of the plan on any other attribute are peeled off, the rest of
+// the plan is materialized, and every one of its range tuples adds the number of its completions
+// through the peeled joins to its group instead of enumerating them. The completions are counted
+// depth-first; the last level contributes the length of its intersection, or the number of
+// distinct values of its range when a single relation holds its attribute. An EH plan whose cut
+// relation holds all those attributes is not enumerated either: each run of its merge adds the
+// product of the matching run lengths of the sub-tables. Every worker aggregates into a
+// GroupTable of its own; the partial tables are merged at the end.
+GroupTable GenericJoin::ExecuteAggregate(std::unique_ptr<LTPlan> plan, uint64_t& resultNum)
+{
+    std::vector<std::string> needed = mOptions.groupBy;
+    std::vector<AggregateOp> ops;
+    for (auto& spec : mOptions.aggregates)
+    {
+        ops.push_back(spec.op);
+        if (spec.op != AggregateOp::Count)
+            needed.push_back(spec.attr);
+    }
+    for (auto& attr : needed)
+        if (std::find(mAttrs.begin(), mAttrs.end(), attr) == mAttrs.end())
+            throw std::invalid_argument("Unknown attribute in aggregation: " + attr);
+
+    const size_t threadNum = mPool->ThreadNum();
+    std::vector<GroupTable> partials(threadNum, GroupTable(mOptions.groupBy.size(), ops));
+    std::vector<uint64_t> partialResults(threadNum, 0);
+
+    // the grouped and aggregated columns, each with the relation it is read from
+    std::vector<std::pair<size_t, const Attribute<int>*>> keyColumns, valueColumns;
+    auto bindColumns = [&](auto&& relationOf){
+        for (auto& attr : mOptions.groupBy)
+            keyColumns.emplace_back(relationOf(attr), &mRelations[relationOf(attr)][attr].get());
+        for (auto& spec : mOptions.aggregates)
+            if (spec.op == AggregateOp::Count)
+                valueColumns.emplace_back(0, nullptr);
+            else
+                valueColumns.emplace_back(relationOf(spec.attr), &mRelations[relationOf(spec.attr)][spec.attr].get());
+    };
+
+    // adds multiplicity results whose columns are read at row rowOf(relation id)
+    std::vector<std::vector<int>> keys(threadNum, std::vector<int>(mOptions.groupBy.size()));
+    std::vector<std::vector<int64_t>> values(threadNum, std::vector<int64_t>(ops.size()));
+    auto add = [&](size_t worker, auto&& rowOf, uint64_t multiplicity){
+        auto& key = keys[worker];
+        auto& value = values[worker];
+        for (size_t i = 0; i < keyColumns.size(); i++)
+            key[i] = (*keyColumns[i].second)[rowOf(keyColumns[i].first)];
+        for (size_t i = 0; i < valueColumns.size(); i++)
+            value[i] = valueColumns[i].second ? (*valueColumns[i].second)[rowOf(valueColumns[i].first)] : 0;
+        partials[worker].Add(key.data(), value.data(), multiplicity);
+        partialResults[worker] += multiplicity;
+    };
+
+    auto finish = [&](const std::string& source){
+        GroupTable groups = std::move(partials[0]);
+        for (size_t worker = 1; worker < threadNum; worker++)
+            groups.Merge(partials[worker]);
+        resultNum = 0;
+        for (uint64_t count : partialResults)
+            resultNum += count;
+
+        if (mOptions.printStats)
+            LogStats("Aggregation: " + source + " -> " + std::to_string(groups.Size()) + " groups");
+        return groups;
+    };
+
+    std::vector<std::unique_ptr<LTPlan>> chain;
+    plan = PeelTopJoins(std::move(plan), chain, [&](const std::string& attr){
+        return std::find(needed.begin(), needed.end(), attr) == needed.end();
+    });
+
+    if (chain.empty() and plan and plan->IsEH())
+    {
+        const size_t cutId = dynamic_cast<EHPlan&>(*plan).mRelationId;
+        auto inCut = [&](const std::string& attr){ return mRelations[cutId].ExistAttr(attr); };
+        if (std::all_of(needed.begin(), needed.end(), inCut))
+        {
+            bindColumns([&](const std::string&){ return cutId; });
+            ExecuteEH(std::move(plan), [&](size_t jrTupleId, const Range* matches, size_t tableNum){
+                uint64_t multiplicity = 1;
+                for (size_t tableId = 0; tableId < tableNum; tableId++)
+                    multiplicity *= matches[tableId].Length();
+                add(mPool->WorkerId(), [&](size_t){ return jrTupleId; }, multiplicity);
+            });
+            return finish("EH merge runs counted");
+        }
+    }
+
+    RangeTable input = ExecuteBelowPipeline(std::move(plan));
+    // every grouped or aggregated attribute is bound in the input, read it from any relation holding it
+    bindColumns([&](const std::string& attr){ return SelectRelationIndices(attr, true).front(); });
+
+    std::vector<std::vector<PipelineLevel>> workerLevels;
+    for (size_t worker = 0; worker < threadNum; worker++)
+        workerLevels.emplace_back(PreparePipeline(chain));
+    // a last level over one relation counts the distinct values of its range
+    const bool distinctLast = !chain.empty() and workerLevels[0].back().relationIndices.size() == 1;
+    if (distinctLast)
+        workerLevels[0].back().attrsData[0].get().BuildDistinctIndex();
+
+    auto completions = [&](auto& self, std::vector<PipelineLevel>& levels, RangeTuple tuple, size_t depth) -> uint64_t {
+        if (depth == levels.size())
+            return 1;
+
+        PipelineLevel& level = levels[depth];
+        if (depth + 1 == levels.size() and distinctLast)
+        {
+            Range range = tuple[level.relationIndices[0]];
+            if (range.Length() == 0)
+                return 0;
+            auto [runSt, runEd] = level.attrsData[0].get().KeySlice(range.st, range.ed);
+            return runEd - runSt;
+        }
+
+        if (depth + 1 == levels.size())
+            return IntersectLevel(level, tuple, true);
+        IntersectLevel(level, tuple);
+
+        // the results of this level are overwritten by the deeper calls at the same level only
+        uint64_t count = 0;
+        for (size_t index = 0; index < level.results.Length(); index++)
+            count += self(self, levels, level.results[index], depth + 1);
+        return count;
+    };
+
+    auto aggregate = [&](size_t worker, size_t st, size_t ed){
+        for (size_t index = st; index < ed; index++)
+        {
+            RangeTuple tuple = input[index];
+            uint64_t multiplicity = completions(completions, workerLevels[worker], tuple, 0);
+            if (multiplicity > 0)
+                add(worker, [&](size_t relId){ return tuple[relId].st; }, multiplicity);
+        }
+    };
+
+    if (threadNum == 1 or input.Length() <= mOptions.morselSize)
+        aggregate(0, 0, input.Length());
+    else
+        mPool->ParallelFor(input.Length(), std::max<size_t>(mOptions.morselSize, 1), aggregate);
+
+    std::string source = std::to_string(input.Length()) + " range tuples below " + std::to_string(chain.size()) + " counted joins";
+    if (mOptions.intersectCacheBytes > 0)
+    {
+        size_t hits = 0, misses = 0;
+        for (auto& levels : workerLevels)
+            for (auto& level : levels)
+            {
+                hits += level.scratch.cache.Hits();
+                misses += level.scratch.cache.Misses();
+            }
+        source += " (cache hits " + std::to_string(hits) + ", misses " + std::to_string(misses) + ")";
+    }
+    return finish(source);
+}
+
+
+void GenericJoin::LogStats(std::string line)
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.emplace_back(std::move(line));
+}
+
+
+Relation GenericJoin::operator()()
+{
+    if (mOptions.intersectMode == IntersectMode::Adaptive or mOptions.loopJoinMode == LoopJoinMode::Adaptive)
+        mCosts = mOptions.calibrationPath.empty() ? CalibrateIntersectCosts() : LoadIntersectCosts(mOptions.calibrationPath);
+
+    if (mOptions.semiJoin)
+        SemiJoinReduce(*mPlan);
+
+    if (mOptions.searchIndexThreshold > 0)
+    {
+        ThreadPool::TaskGroup group(*mPool);
+        for (auto& relation : mRelations)
+            group.Run([&]{ BuildSearchIndexes(relation); });
+        group.Wait();
+    }
+
+    if (!mOptions.groupBy.empty() or !mOptions.aggregates.empty())
+    {
+        uint64_t resultNum = 0;
+        GroupTable groups = ExecuteAggregate(std::move(mPlan), resultNum);
+
+        mResultNum = resultNum;
+        std::cout << "Join results number: " << resultNum << std::endl;
+        std::cout << "Aggregate groups: " << groups.Size() << std::endl;
+        if (mOptions.printStats)
+            for (auto& line : mStats)
+                std::cout << "  " << line << std::endl;
+
+        // the groups with the smallest keys
+        std::vector<size_t> order(groups.Size());
+        std::iota(order.begin(), order.end(), 0);
+        const size_t printNum = std::min(PrintedGroupNum, order.size());
+        const size_t keyWidth = mOptions.groupBy.size();
+        std::partial_sort(order.begin(), order.begin() + printNum, order.end(), [&](size_t group1, size_t group2){
+            return std::lexicographical_compare(groups.Key(group1), groups.Key(group1) + keyWidth, groups.Key(group2), groups.Key(group2) + keyWidth);
+        });
+        for (auto& attr : mOptions.groupBy)
+            std::cout << attr << "  ";
+        for (auto& spec : mOptions.aggregates)
+            std::cout << AggregateName(spec) << "  ";
+        std::cout << std::endl;
+        for (size_t i = 0; i < printNum; i++)
+        {
+            for (size_t k = 0; k < keyWidth; k++)
+                std::cout << groups.Key(order[i])[k] << "  ";
+            for (size_t k = 0; k < mOptions.aggregates.size(); k++)
+                std::cout << groups.Accumulators(order[i])[k] << "  ";
+            std::cout << std::endl;
+        }
+
+        return Relation();
+    }
+
+    auto rangeTable = mOptions.limit > 0 ? ExecutePipelined(std::move(mPlan), mOptions.limit) : Execute(std::move(mPlan));
+
+    mResultNum = rangeTable.Length();
+    std::cout << "Join results number: " << rangeTable.Length() << std::endl;
+    if (mOptions.exists)
+        std::cout << "Join results exist: " << (rangeTable.Length() > 0 ? "yes" : "no") << std::endl;
+    if (mOptions.printStats)
+        for (auto& line : mStats)
+            std::cout << "  " << line << std::endl;
+    // rangeTable.Print();
+
+    // Convert range table to relation
+    Relation result;
+    /*
+    for (size_t attrIndex = 0; attrIndex < rangeTable.Width(); attrIndex++)
+    {
+        std::string attrName = mAttrs[attrIndex];
+        std::vector<int> attrData(rangeTable.Length());
+
+        for (auto& rel : mRelations)
+            if (rel.ExistAttr(attrName))
+            {
+                const auto& attr = rel[attrName];
+                for (size_t tupleIndex = 0; tupleIndex < rangeTable.Length(); tupleIndex++)
+                {
+                    RangeTuple rangeTuple = rangeTable[tupleIndex];
+                    int value = attr[rangeTuple[attrIndex].st];
+                    attrData[tupleIndex] = value;
+                }
+
+                break;
+            }
+
+        result.SetTupleNum(attrData.size());
+        result.Insert(attrName, std::move(attrData));
+    }
+
+    std::cout << "Final result: " << result.Length() <<std::endl;
+    */
+
+    return result;
+
+    /*
+    // create the primary range table
+    RangeTable rangeTable(mRelations.size(), 1);
+    {
+        RangeTuple tuple = rangeTable.AcquireTuple();
+        for (int i = 0; i < mRelations.size(); i++)
+        {
+            rangeTable[0][i].st = 0;
+            rangeTable[0][i].ed = mRelations[i].Length();
+        }
+    }
+
+    // for (const auto& attr : mPlan)
+    for (size_t attrIndexx = 0; attrIndexx < mPlan.size(); attrIndexx++)
+    {
+        const auto& attr = mPlan[attrIndexx];
+
+        if constexpr (Debug)
+        {
+            std::cout << std::endl << "Joining attribute " << attr << std::endl;
+            std::cout << "There exists " << rangeTable.Length() << " tuples in range table." << std::endl;
+        }
+
+        if (rangeTable.Length() == 0)
+        {
+            if constexpr(Debug)
+                std::cout << "No range tuples left, stopping join." << std::endl;
+            break;
+        }
+
+        auto relationIndices  = SelectRelationIndices(attr, true);
+        auto relationIndicesC = SelectRelationIndices(attr, false);
+
+        auto attrsData = FetchAttributes(relationIndices, attr);
+
+        RangeTable nextRangeTable = CreateEstimatedRangeTable(rangeTable, relationIndices, mRelations.size());
+
+        for (size_t rangeTupleIndex = 0; rangeTupleIndex < rangeTable.Length(); rangeTupleIndex++)
+        {
+            RangeTuple rangeTuple = rangeTable[rangeTupleIndex];
+            size_t shortestRelationIndex = ShortestRangeIndex(rangeTuple, relationIndices);
+
+            {
+                Range baseRange = rangeTuple[shortestRelationIndex];
+                auto baseAttr = mRelations[shortestRelationIndex][attr];
+
+                for (size_t attrIndex = baseRange.st; attrIndex < baseRange.ed; attrIndex++)
                 {
                     int value = baseAttr.get()[attrIndex];
                     if (attrIndex != baseRange.st and value == baseAttr.get()[attrIndex-1])
@@ -597,6 +1399,86 @@ Relation GenericJoin::operator()()
 }
 
 
+// Scratch space of the intersection kernels the options select, over the given participating
+// attributes; also builds the distinct indexes the SIMD and bitmap kernels need
+GenericJoin::IntersectScratch GenericJoin::PrepareScratch(const std::vector<size_t>& relationIndices, std::vector<AttributeRef<int>>& attrsData)
+{
+    IntersectScratch scratch;
+    scratch.cursors.resize(relationIndices.size());
+    scratch.runEnds.resize(relationIndices.size());
+    scratch.subTuple.resize(mRelations.size());
+    if (mOptions.intersectMode == IntersectMode::Batched)
+    {
+        const size_t batchSize = std::max<size_t>(mOptions.batchSize, 1);
+        scratch.batchValues.resize(batchSize);
+        scratch.batchLowers.resize(batchSize);
+        scratch.batchUppers.resize(batchSize);
+        scratch.batchRanges.resize(batchSize * relationIndices.size());
+    }
+    else if ((mOptions.intersectMode == IntersectMode::BinarySearch or mOptions.intersectMode == IntersectMode::Adaptive) and
+             mOptions.interleave > 0)
+    {
+        scratch.batchValues.resize(ProbeChunkSize);
+        scratch.batchRanges.resize(ProbeChunkSize * relationIndices.size());
+        for (auto& attrData : attrsData)
+            scratch.probeColumns.push_back(attrData.get().Raw().data());
+    }
+    if (mOptions.intersectMode == IntersectMode::Simd or mOptions.intersectMode == IntersectMode::Bitmap or
+        mOptions.intersectMode == IntersectMode::Adaptive or mOptions.heavyThreshold > 0)
+    {
+        size_t maxKeyNum = std::numeric_limits<size_t>::max();
+        for (auto& attrData : attrsData)
+        {
+            attrData.get().BuildDistinctIndex();
+            maxKeyNum = std::min(maxKeyNum, attrData.get().DistinctKeys().size());
+        }
+        scratch.keys.resize(maxKeyNum);
+        scratch.swapKeys.resize(maxKeyNum);
+    }
+    // every thread intersects with a scratch of its own, so they split the cache budget
+    if (mOptions.intersectCacheBytes > 0)
+    {
+        scratch.cache = IntersectionCache(relationIndices.size(), mOptions.intersectCacheBytes / mPool->ThreadNum());
+        scratch.cacheKey.resize(relationIndices.size());
+    }
+
+    return scratch;
+}
+
+bool GenericJoin::AppendCachedResults(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, IntersectScratch& scratch, RangeTable& out)
+{
+    const size_t relNum = relationIndices.size();
+    for (size_t i = 0; i < relNum; i++)
+        scratch.cacheKey[i] = rangeTuple[relationIndices[i]];
+
+    const Range* results = nullptr;
+    size_t resultNum = 0;
+    if (!scratch.cache.Find(scratch.cacheKey.data(), results, resultNum))
+        return false;
+
+    for (size_t result = 0; result < resultNum; result++)
+    {
+        RangeTuple tuple = out.AcquireTuple();
+        std::copy_n(rangeTuple, mRelations.size(), tuple);
+        for (size_t i = 0; i < relNum; i++)
+            tuple[relationIndices[i]] = results[result * relNum + i];
+    }
+    return true;
+}
+
+void GenericJoin::CacheResults(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, IntersectScratch& scratch, RangeTable& out, size_t first)
+{
+    const size_t relNum = relationIndices.size();
+    for (size_t i = 0; i < relNum; i++)
+        scratch.cacheKey[i] = rangeTuple[relationIndices[i]];
+
+    scratch.cacheResults.clear();
+    for (size_t index = first; index < out.Length(); index++)
+        for (size_t relId : relationIndices)
+            scratch.cacheResults.push_back(out[index][relId]);
+    scratch.cache.Insert(scratch.cacheKey.data(), scratch.cacheResults.data(), out.Length() - first);
+}
+
 RangeTable GenericJoin::SingleAttrWCOJoin(RangeTableRef rangeTableRef, std::vector<size_t>& relIndices, std::string attr, double cost)
 {
     auto& rangeTable = rangeTableRef.get();
@@ -629,69 +1511,624 @@ RangeTable GenericJoin::SingleAttrWCOJoin(RangeTableRef rangeTableRef, std::vect
     // for (size_t index : relationIndices)
     //     nextRangeTable.AddRelName(index);
 
-    for (size_t rangeTupleIndex = 0; rangeTupleIndex < rangeTable.Length(); rangeTupleIndex++)
+    std::vector<AttributeRef<int>> attrsData = FetchAttributes(relationIndices, attr);
+    const bool splitHeavy = mOptions.heavyThreshold > 0;
+    IntersectScratch scratch = PrepareScratch(relationIndices, attrsData);
+    const bool adaptive = mOptions.intersectMode == IntersectMode::Adaptive;
+
+    // A range tuple whose shortest range exceeds heavyThreshold rows is heavy: its shortest range is
+    // cut at distinct value boundaries into pieces of about heavyThreshold rows, every piece is a
+    // unit of work of its own and probes the bitmaps of the other, dense ranges.
+    std::vector<HeavyPiece> heavyPieces;
+    std::vector<size_t> unitPieces;     // index into heavyPieces + 1 per unit, 0 for a light tuple
+    std::vector<size_t> unitTuples;
+    if (splitHeavy)
+    {
+        for (size_t rangeTupleIndex = 0; rangeTupleIndex < rangeTable.Length(); rangeTupleIndex++)
+        {
+            RangeTuple rangeTuple = rangeTable[rangeTupleIndex];
+            size_t driver = 0;
+            for (size_t i = 1; i < relationIndices.size(); i++)
+                if (rangeTuple[relationIndices[i]].Length() < rangeTuple[relationIndices[driver]].Length())
+                    driver = i;
+
+            Range range = rangeTuple[relationIndices[driver]];
+            if (range.Length() <= mOptions.heavyThreshold)
+            {
+                unitTuples.push_back(rangeTupleIndex);
+                unitPieces.push_back(0);
+                continue;
+            }
+
+            auto& driverAttr = attrsData[driver].get();
+            for (size_t st = range.st; st < range.ed; )
+            {
+                size_t ed = std::min(st + mOptions.heavyThreshold, range.ed);
+                if (ed < range.ed and driverAttr[ed] == driverAttr[ed - 1])
+                    ed = std::min(driverAttr.RunStart(driverAttr.RunOf(ed) + 1), range.ed);
+
+                heavyPieces.push_back(HeavyPiece{relationIndices[driver], Range{st, ed}});
+                unitTuples.push_back(rangeTupleIndex);
+                unitPieces.push_back(heavyPieces.size());
+                st = ed;
+            }
+        }
+
+        if constexpr (Debug)
+            std::cout << "WCO join on " << attr << ": " << heavyPieces.size() << " heavy pieces in " << unitTuples.size() << " units" << std::endl;
+    }
+
+    // binary search and galloping over 2..8 relations run in kernels unrolled for that count,
+    // except binary search when it is interleaved
+    TupleKernel binaryKernel, gallopKernel;
+    if (mOptions.specializeKernels)
+    {
+        if ((mOptions.intersectMode == IntersectMode::BinarySearch or adaptive) and mOptions.interleave == 0)
+            binaryKernel = SelectFixedKernel(relationIndices, attrsData, mRelations.size(), false);
+        if (mOptions.intersectMode == IntersectMode::Galloping or adaptive)
+            gallopKernel = SelectFixedKernel(relationIndices, attrsData, mRelations.size(), true);
+    }
+
+    auto intersectTuple = [&](RangeTuple rangeTuple, IntersectScratch& scratch, RangeTable& out){
+        IntersectMode mode = mOptions.intersectMode;
+        if (adaptive)
+        {
+            mode = SelectIntersectMode(rangeTuple, relationIndices, attrsData);
+            scratch.strategyTuples[static_cast<size_t>(mode)]++;
+        }
+
+        if (mode == IntersectMode::BinarySearch and binaryKernel)
+            binaryKernel(rangeTuple, out);
+        else if (mode == IntersectMode::Galloping and gallopKernel)
+            gallopKernel(rangeTuple, out);
+        else
+            IntersectRangeTuple(mode, rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, out);
+    };
+
+    auto processTuple = [&](RangeTuple rangeTuple, IntersectScratch& scratch, RangeTable& out){
+        if (!scratch.cache.Enabled() or scratch.cache.Bypassed())
+        {
+            intersectTuple(rangeTuple, scratch, out);
+            return;
+        }
+
+        if (AppendCachedResults(rangeTuple, relationIndices, scratch, out))
+            return;
+        const size_t first = out.Length();
+        intersectTuple(rangeTuple, scratch, out);
+        CacheResults(rangeTuple, relationIndices, scratch, out, first);
+    };
+
+    const size_t unitNum = splitHeavy ? unitTuples.size() : rangeTable.Length();
+    auto processUnit = [&](size_t unit, IntersectScratch& scratch, RangeTable& out){
+        if (!splitHeavy)
+        {
+            processTuple(rangeTable[unit], scratch, out);
+            return;
+        }
+
+        RangeTuple rangeTuple = rangeTable[unitTuples[unit]];
+        if (unitPieces[unit] == 0)
+        {
+            processTuple(rangeTuple, scratch, out);
+            return;
+        }
+
+        auto& piece = heavyPieces[unitPieces[unit] - 1];
+        std::copy(rangeTuple, rangeTuple + mRelations.size(), scratch.subTuple.begin());
+        scratch.subTuple[piece.relationIndex] = piece.range;
+        BitmapIntersect(scratch.subTuple.data(), relationIndices, relationIndicesC, attrsData, scratch, out);
+    };
+
+    size_t cacheHits = 0, cacheMisses = 0, cacheEvictions = 0;
+    bool cacheBypassed = false;
+    const size_t morselSize = std::max<size_t>(mOptions.morselSize, 1);
+    if (mPool->ThreadNum() == 1 or unitNum <= morselSize)
+    {
+        for (size_t unit = 0; unit < unitNum; unit++)
+            processUnit(unit, scratch, nextRangeTable);
+        cacheHits = scratch.cache.Hits();
+        cacheMisses = scratch.cache.Misses();
+        cacheEvictions = scratch.cache.Evictions();
+        cacheBypassed = scratch.cache.Bypassed();
+    }
+    else
+    {
+        // one output chunk per thread, or per morsel when the input order has to be kept. The
+        // chunks grow with their results, so the estimated table is released instead of being
+        // held next to them, and the results are copied into a table of their exact size.
+        const size_t morselNum = (unitNum + morselSize - 1) / morselSize;
+        const size_t chunkNum = mOptions.preserveOrder ? morselNum : mPool->ThreadNum();
+        nextRangeTable.ShrinkToFit();
+        std::vector<RangeTable> chunks;
+        chunks.reserve(chunkNum);
+        for (size_t chunkIndex = 0; chunkIndex < chunkNum; chunkIndex++)
+            chunks.emplace_back(mRelations.size(), 0);
+        std::vector<IntersectScratch> scratches(mPool->ThreadNum(), scratch);
+
+        mPool->ParallelFor(unitNum, morselSize, [&](size_t workerId, size_t st, size_t ed){
+            RangeTable& chunk = chunks[mOptions.preserveOrder ? st / morselSize : workerId];
+            for (size_t unit = st; unit < ed; unit++)
+                processUnit(unit, scratches[workerId], chunk);
+        });
+
+        size_t resultNum = 0;
+        for (auto& chunk : chunks)
+            resultNum += chunk.Length();
+        nextRangeTable.Reserve(resultNum);
+        for (auto& chunk : chunks)
+        {
+            nextRangeTable.Append(chunk);
+            chunk = RangeTable(mRelations.size(), 0);
+        }
+        for (auto& workerScratch : scratches)
+        {
+            for (size_t mode = 0; mode < scratch.strategyTuples.size(); mode++)
+                scratch.strategyTuples[mode] += workerScratch.strategyTuples[mode];
+            cacheHits += workerScratch.cache.Hits();
+            cacheMisses += workerScratch.cache.Misses();
+            cacheEvictions += workerScratch.cache.Evictions();
+            cacheBypassed = cacheBypassed or workerScratch.cache.Bypassed();
+        }
+    }
+
+    if (mOptions.printStats)
+    {
+        auto& counts = scratch.strategyTuples;
+        std::string line = "WCO join on " + attr + ": " + std::to_string(rangeTable.Length()) + " range tuples -> " +
+                           std::to_string(nextRangeTable.Length());
+        if (adaptive)
+            line += ", binary " + std::to_string(counts[0]) + ", galloping " + std::to_string(counts[1]) +
+                    ", simd " + std::to_string(counts[2]) + ", bitmap " + std::to_string(counts[3]);
+        if (scratch.cache.Enabled())
+            line += ", cache hits " + std::to_string(cacheHits) + ", misses " + std::to_string(cacheMisses) +
+                    ", evictions " + std::to_string(cacheEvictions) +
+                    (cacheBypassed ? ", bypassed" : "");
+        LogStats(std::move(line));
+    }
+
+    if constexpr (Debug)
+    {
+        std::cout << "WCO join on " << attr << " result size: " << nextRangeTable.Length() << std::endl;
+    }
+
+    return nextRangeTable;
+}
+
+// Picks the cheapest strategy for one range tuple from the calibrated costs. With c candidate
+// values (the distinct keys of the shortest range), binary search costs two searches per
+// candidate and range, galloping two exponential searches over the average gap, the SIMD merge
+// one step per distinct key, and bitmaps one probe per candidate and dense range once a range
+// reaches bitmapThreshold keys.
+IntersectMode GenericJoin::SelectIntersectMode(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, std::vector<AttributeRef<int>>& attrsData)
+{
+    const size_t relNum = relationIndices.size();
+    size_t candidates = std::numeric_limits<size_t>::max();
+    size_t totalKeys = 0;
+    size_t denseNum = 0;
+    double searchSteps = 0;
+    for (size_t i = 0; i < relNum; i++)
     {
-        RangeTuple rangeTuple = rangeTable[rangeTupleIndex];
-        size_t shortestRelationIndex = ShortestRangeIndex(rangeTuple, relationIndices);
+        Range range = rangeTuple[relationIndices[i]];
+        if (!range.Valid())
+            return IntersectMode::BinarySearch;
+
+        auto [runSt, runEd] = attrsData[i].get().KeySlice(range.st, range.ed);
+        size_t keyNum = runEd - runSt;
+        candidates = std::min(candidates, keyNum);
+        totalKeys += keyNum;
+        denseNum += keyNum >= mOptions.bitmapThreshold;
+        searchSteps += std::bit_width(range.Length());
+    }
+
+    double gallopSteps = 0;
+    for (size_t i = 0; i < relNum; i++)
+        gallopSteps += std::bit_width(rangeTuple[relationIndices[i]].Length() / candidates);
+
+    double binaryCost = 2 * candidates * searchSteps * mCosts.searchStep;
+    double gallopCost = 2 * candidates * (gallopSteps + relNum) * mCosts.gallopStep;
+    double simdCost = totalKeys * mCosts.mergeKey;
+    double bitmapCost = denseNum > 0 ? candidates * relNum * mCosts.bitmapProbe : std::numeric_limits<double>::max();
+
+    double best = std::min({binaryCost, gallopCost, simdCost, bitmapCost});
+    if (best == binaryCost)
+        return IntersectMode::BinarySearch;
+    if (best == gallopCost)
+        return IntersectMode::Galloping;
+    if (best == simdCost)
+        return IntersectMode::Simd;
+    return IntersectMode::Bitmap;
+}
 
+void GenericJoin::IntersectRangeTuple(IntersectMode mode, RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                                      std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable)
+{
+    if (mode == IntersectMode::Galloping)
+        GallopingIntersect(rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, nextRangeTable);
+    else if (mode == IntersectMode::Simd)
+        SimdIntersect(rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, nextRangeTable);
+    else if (mode == IntersectMode::Bitmap)
+        BitmapIntersect(rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, nextRangeTable);
+    else if (mode == IntersectMode::Batched)
+        BatchedIntersect(rangeTuple, relationIndices, attrsData, scratch, nextRangeTable);
+    else if (mOptions.interleave > 0 and !scratch.probeColumns.empty())
+        InterleavedIntersect(rangeTuple, relationIndices, scratch, nextRangeTable);
+    else
+        BinarySearchIntersect(rangeTuple, relationIndices, relationIndicesC, attrsData, nextRangeTable);
+}
+
+// Collects the distinct values of the shortest range in batches and looks every batch up in all
+// participating ranges with BatchBound, dropping the values missing from a range before the next.
+void GenericJoin::BatchedIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices,
+                                   std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable)
+{
+    const size_t relNum = relationIndices.size();
+    const size_t batchSize = scratch.batchValues.size();
+    const size_t width = mRelations.size();
+    int* values = scratch.batchValues.data();
+    size_t* lowers = scratch.batchLowers.data();
+    size_t* uppers = scratch.batchUppers.data();
+    Range* ranges = scratch.batchRanges.data();
+
+    size_t shortest = 0;
+    for (size_t i = 1; i < relNum; i++)
+        if (rangeTuple[relationIndices[i]].Length() < rangeTuple[relationIndices[shortest]].Length())
+            shortest = i;
+    Range baseRange = rangeTuple[relationIndices[shortest]];
+    const int* base = attrsData[shortest].get().Raw().data();
+
+    size_t attrIndex = baseRange.st;
+    while (attrIndex < baseRange.ed)
+    {
+        size_t count = 0;
+        for (; attrIndex < baseRange.ed and count < batchSize; attrIndex++)
+            if (attrIndex == baseRange.st or base[attrIndex] != base[attrIndex - 1])
+                values[count++] = base[attrIndex];
+
+        for (size_t i = 0; i < relNum and count > 0; i++)
         {
-            Range baseRange = rangeTuple[shortestRelationIndex];
-            auto& baseAttr = mRelations[shortestRelationIndex][attr].get();
+            Range range = rangeTuple[relationIndices[i]];
+            const int* column = attrsData[i].get().Raw().data();
+            BatchBound(column, range.st, range.ed, values, count, false, lowers);
+            BatchBound(column, range.st, range.ed, values, count, true, uppers);
 
-            for (size_t attrIndex = baseRange.st; attrIndex < baseRange.ed; attrIndex++)
+            size_t kept = 0;
+            for (size_t b = 0; b < count; b++)
             {
-                int value = baseAttr[attrIndex];
-                if (attrIndex != baseRange.st and value == baseAttr[attrIndex-1])
-                    continue;
-                
-                bool valueExsit = true;
+                if (kept != b)
                 {
-                    for (size_t relationIndex : relationIndices)
-                    {
-                        auto& targetAttr = mRelations[relationIndex][attr].get();
-                        size_t startQueryIndex = rangeTuple[relationIndex].st;
-                        size_t endQueryIndex   = rangeTuple[relationIndex].ed;
-
-                        const auto& [start, end] = targetAttr.Query(startQueryIndex, endQueryIndex, value);
-                        if (start == end)
-                        {
-                            valueExsit = false;
-                            break;
-                        }
-                    }
+                    values[kept] = values[b];
+                    std::copy_n(ranges + b * relNum, i, ranges + kept * relNum);
                 }
+                ranges[kept * relNum + i] = Range{lowers[b], uppers[b]};
+                kept += lowers[b] < uppers[b];
+            }
+            count = kept;
+        }
 
-                if (valueExsit)
-                {
-                    RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+        for (size_t b = 0; b < count; b++)
+        {
+            RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+            std::copy_n(rangeTuple, width, storeTuple);
+            for (size_t i = 0; i < relNum; i++)
+                storeTuple[relationIndices[i]] = ranges[b * relNum + i];
+        }
+    }
+}
 
-                    for (size_t relationIndex : relationIndices)
-                    {
-                        auto& targetAttr = mRelations[relationIndex][attr].get();
-                        size_t startQueryIndex = rangeTuple[relationIndex].st;
-                        size_t endQueryIndex   = rangeTuple[relationIndex].ed;
+// Binary search of every participating range for each distinct value of the shortest one, with
+// the searches of up to ProbeChunkSize values run as ProbeRanges coroutines interleaved by
+// Interleave. Results are emitted in value order.
+void GenericJoin::InterleavedIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices,
+                                       IntersectScratch& scratch, RangeTable& nextRangeTable)
+{
+    const size_t relNum = relationIndices.size();
+    const size_t width = mRelations.size();
+    int* values = scratch.batchValues.data();
+    Range* ranges = scratch.batchRanges.data();
+
+    size_t shortest = 0;
+    for (size_t i = 1; i < relNum; i++)
+        if (rangeTuple[relationIndices[i]].Length() < rangeTuple[relationIndices[shortest]].Length())
+            shortest = i;
+    Range baseRange = rangeTuple[relationIndices[shortest]];
+    const int* base = scratch.probeColumns[shortest];
+
+    size_t attrIndex = baseRange.st;
+    while (attrIndex < baseRange.ed)
+    {
+        size_t count = 0;
+        for (; attrIndex < baseRange.ed and count < ProbeChunkSize; attrIndex++)
+            if (attrIndex == baseRange.st or base[attrIndex] != base[attrIndex - 1])
+                values[count++] = base[attrIndex];
 
-                        const auto& [start, end] = targetAttr.Query(startQueryIndex, endQueryIndex, value);
-                        storeTuple[relationIndex].st = start - targetAttr.Begin();
-                        storeTuple[relationIndex].ed = end - targetAttr.Begin();
-                    }
+        Interleave(count, mOptions.interleave, [&](size_t b){
+            return ProbeRanges(rangeTuple, relationIndices.data(), scratch.probeColumns.data(), relNum, values[b], ranges + b * relNum);
+        });
 
-                    for (size_t relationIndex : relationIndicesC)
-                    {
-                        storeTuple[relationIndex].st = rangeTuple[relationIndex].st;
-                        storeTuple[relationIndex].ed = rangeTuple[relationIndex].ed;
-                    }
+        for (size_t b = 0; b < count; b++)
+        {
+            if (!ranges[b * relNum].Valid())
+                continue;
+
+            RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+            std::copy_n(rangeTuple, width, storeTuple);
+            for (size_t i = 0; i < relNum; i++)
+                storeTuple[relationIndices[i]] = ranges[b * relNum + i];
+        }
+    }
+}
+
+void GenericJoin::BinarySearchIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                                        std::vector<AttributeRef<int>>& attrsData, RangeTable& nextRangeTable)
+{
+    size_t shortest = 0;
+    for (size_t i = 1; i < relationIndices.size(); i++)
+        if (rangeTuple[relationIndices[i]].Length() < rangeTuple[relationIndices[shortest]].Length())
+            shortest = i;
+    Range baseRange = rangeTuple[relationIndices[shortest]];
+    auto& baseAttr = attrsData[shortest].get();
+
+    for (size_t attrIndex = baseRange.st; attrIndex < baseRange.ed; attrIndex++)
+    {
+        int value = baseAttr[attrIndex];
+        if (attrIndex != baseRange.st and value == baseAttr[attrIndex-1])
+            continue;
+
+        bool valueExsit = true;
+        {
+            for (size_t i = 0; i < relationIndices.size(); i++)
+            {
+                auto& targetAttr = attrsData[i].get();
+                size_t startQueryIndex = rangeTuple[relationIndices[i]].st;
+                size_t endQueryIndex   = rangeTuple[relationIndices[i]].ed;
+
+                const auto& [start, end] = targetAttr.Query(startQueryIndex, endQueryIndex, value);
+                if (start == end)
+                {
+                    valueExsit = false;
+                    break;
                 }
             }
         }
+
+        if (valueExsit)
+        {
+            RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+
+            for (size_t i = 0; i < relationIndices.size(); i++)
+            {
+                auto& targetAttr = attrsData[i].get();
+                size_t startQueryIndex = rangeTuple[relationIndices[i]].st;
+                size_t endQueryIndex   = rangeTuple[relationIndices[i]].ed;
+
+                const auto& [start, end] = targetAttr.Query(startQueryIndex, endQueryIndex, value);
+                storeTuple[relationIndices[i]].st = start - targetAttr.Begin();
+                storeTuple[relationIndices[i]].ed = end - targetAttr.Begin();
+            }
+
+            for (size_t relationIndex : relationIndicesC)
+            {
+                storeTuple[relationIndex].st = rangeTuple[relationIndex].st;
+                storeTuple[relationIndex].ed = rangeTuple[relationIndex].ed;
+            }
+        }
     }
+}
 
-    if constexpr (Debug)
+// Leapfrog intersection of the participating ranges of one range tuple. The candidate value only
+// grows, so each cursor moves forward with exponential search and every child range is computed once.
+void GenericJoin::GallopingIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                                     std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable)
+{
+    auto& cursors = scratch.cursors;
+    const size_t relNum = relationIndices.size();
+    for (size_t i = 0; i < relNum; i++)
     {
-        std::cout << "WCO join on " << attr << " result size: " << nextRangeTable.Length() << std::endl;
+        cursors[i] = rangeTuple[relationIndices[i]].st;
+        if (cursors[i] >= rangeTuple[relationIndices[i]].ed)
+            return;
     }
 
-    return nextRangeTable;
+    int candidate = attrsData[0].get()[cursors[0]];
+    size_t agreed = 0;
+    size_t i = 0;
+    while (true)
+    {
+        auto& targetAttr = attrsData[i].get();
+        size_t endQueryIndex = rangeTuple[relationIndices[i]].ed;
+
+        cursors[i] = targetAttr.GallopLowerBound(cursors[i], endQueryIndex, candidate);
+        if (cursors[i] == endQueryIndex)
+            return;
+
+        int value = targetAttr[cursors[i]];
+        if (value != candidate)
+        {
+            candidate = value;
+            agreed = 1;
+            i = (i + 1) % relNum;
+            continue;
+        }
+        if (++agreed < relNum)
+        {
+            i = (i + 1) % relNum;
+            continue;
+        }
+
+        // every relation agrees on candidate
+        bool exhausted = false;
+        RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+        for (size_t j = 0; j < relNum; j++)
+        {
+            size_t relationIndex = relationIndices[j];
+            size_t upper = attrsData[j].get().GallopUpperBound(cursors[j], rangeTuple[relationIndex].ed, candidate);
+
+            storeTuple[relationIndex].st = cursors[j];
+            storeTuple[relationIndex].ed = upper;
+            cursors[j] = upper;
+            if (upper == rangeTuple[relationIndex].ed)
+                exhausted = true;
+        }
+
+        for (size_t relationIndex : relationIndicesC)
+        {
+            storeTuple[relationIndex].st = rangeTuple[relationIndex].st;
+            storeTuple[relationIndex].ed = rangeTuple[relationIndex].ed;
+        }
+
+        if (exhausted)
+            return;
+
+        // restart from relation i, whose cursor now sits on its next distinct value
+        candidate = targetAttr[cursors[i]];
+        agreed = 0;
+    }
+}
+
+// Intersects the distinct keys of the participating ranges with the SIMD kernels, smallest key
+// slices first, then maps every common key back to its run inside each range.
+void GenericJoin::SimdIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                                std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable)
+{
+    const size_t relNum = relationIndices.size();
+    auto& runCursors = scratch.cursors;
+    auto& runEnds = scratch.runEnds;
+    auto& order = scratch.order;
+
+    order.resize(relNum);
+    for (size_t i = 0; i < relNum; i++)
+    {
+        Range range = rangeTuple[relationIndices[i]];
+        if (!range.Valid())
+            return;
+        std::tie(runCursors[i], runEnds[i]) = attrsData[i].get().KeySlice(range.st, range.ed);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+        [&](size_t i1, size_t i2){ return runEnds[i1] - runCursors[i1] < runEnds[i2] - runCursors[i2]; });
+
+    const int* common = attrsData[order[0]].get().DistinctKeys().data() + runCursors[order[0]];
+    size_t commonNum = runEnds[order[0]] - runCursors[order[0]];
+    for (size_t k = 1; k < relNum and commonNum > 0; k++)
+    {
+        size_t i = order[k];
+        const int* keys = attrsData[i].get().DistinctKeys().data() + runCursors[i];
+        int* out = common == scratch.keys.data() ? scratch.swapKeys.data() : scratch.keys.data();
+        commonNum = IntersectSorted(common, commonNum, keys, runEnds[i] - runCursors[i], out);
+        common = out;
+    }
+
+    EmitCommonKeys(rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, common, commonNum, nextRangeTable);
+}
+
+// Ranges with at least bitmapThreshold distinct keys take part through their bitmaps: if every
+// range is dense the bitmaps are ANDed, otherwise the smallest sparse key slice drives, merged
+// with the other sparse slices and probed against the bitmaps.
+void GenericJoin::BitmapIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                                  std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable)
+{
+    const size_t relNum = relationIndices.size();
+    auto& runCursors = scratch.cursors;
+    auto& runEnds = scratch.runEnds;
+    auto& sparse = scratch.order;
+    auto& bitmaps = scratch.bitmaps;
+    auto& candidates = scratch.candidates;
+
+    sparse.clear();
+    bitmaps.clear();
+    for (size_t i = 0; i < relNum; i++)
+    {
+        Range range = rangeTuple[relationIndices[i]];
+        if (!range.Valid())
+            return;
+        std::tie(runCursors[i], runEnds[i]) = attrsData[i].get().KeySlice(range.st, range.ed);
+
+        if (runEnds[i] - runCursors[i] >= mOptions.bitmapThreshold)
+            bitmaps.push_back(attrsData[i].get().DenseBitmap(range.st, range.ed));
+        else
+            sparse.push_back(i);
+    }
+
+    if (bitmaps.empty())
+    {
+        SimdIntersect(rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, nextRangeTable);
+        return;
+    }
+
+    candidates.clear();
+    if (sparse.empty())
+    {
+        if (bitmaps.size() == 1)
+            bitmaps[0]->Collect(candidates);
+        else
+        {
+            RoaringBitmap common = RoaringBitmap::And(*bitmaps[0], *bitmaps[1]);
+            for (size_t k = 2; k < bitmaps.size(); k++)
+                common = RoaringBitmap::And(common, *bitmaps[k]);
+            common.Collect(candidates);
+        }
+    }
+    else
+    {
+        std::sort(sparse.begin(), sparse.end(),
+            [&](size_t i1, size_t i2){ return runEnds[i1] - runCursors[i1] < runEnds[i2] - runCursors[i2]; });
+
+        size_t driver = sparse[0];
+        auto& driverKeys = attrsData[driver].get().DistinctKeys();
+        auto& keyCursors = scratch.keyCursors;
+        keyCursors = runCursors;
+        for (size_t run = runCursors[driver]; run < runEnds[driver]; run++)
+        {
+            int value = driverKeys[run];
+            bool valueExist = true;
+            for (size_t k = 1; k < sparse.size() and valueExist; k++)
+            {
+                size_t i = sparse[k];
+                auto& keys = attrsData[i].get().DistinctKeys();
+                keyCursors[i] = GallopLowerBound(keys, keyCursors[i], runEnds[i], value);
+                valueExist = keyCursors[i] < runEnds[i] and keys[keyCursors[i]] == value;
+            }
+            for (size_t b = 0; b < bitmaps.size() and valueExist; b++)
+                valueExist = bitmaps[b]->Contains(value);
+
+            if (valueExist)
+                candidates.push_back(value);
+        }
+    }
+
+    EmitCommonKeys(rangeTuple, relationIndices, relationIndicesC, attrsData, scratch, candidates.data(), candidates.size(), nextRangeTable);
+}
+
+// Emits one range tuple per common key. runCursors/runEnds hold the key slice of every range.
+void GenericJoin::EmitCommonKeys(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                                 std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch,
+                                 const int* common, size_t commonNum, RangeTable& nextRangeTable)
+{
+    auto& runCursors = scratch.cursors;
+    auto& runEnds = scratch.runEnds;
+
+    for (size_t c = 0; c < commonNum; c++)
+    {
+        int value = common[c];
+        RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+        for (size_t i = 0; i < relationIndices.size(); i++)
+        {
+            auto& targetAttr = attrsData[i].get();
+            size_t relationIndex = relationIndices[i];
+            size_t run = GallopLowerBound(targetAttr.DistinctKeys(), runCursors[i], runEnds[i], value);
+
+            storeTuple[relationIndex].st = std::max(targetAttr.RunStart(run), rangeTuple[relationIndex].st);
+            storeTuple[relationIndex].ed = std::min(targetAttr.RunStart(run + 1), rangeTuple[relationIndex].ed);
+            runCursors[i] = run + 1;
+        }
+
+        for (size_t relationIndex : relationIndicesC)
+        {
+            storeTuple[relationIndex].st = rangeTuple[relationIndex].st;
+            storeTuple[relationIndex].ed = rangeTuple[relationIndex].ed;
+        }
+    }
 }
 
 RangeTable GenericJoin::SingleAttrCartesianJoin(std::vector<RangeTableRef>& tableRefs, double cost)
@@ -767,19 +2204,19 @@ RangeTable GenericJoin::SingleAttrLoopJoin(std::vector<RangeTableRef>& tableRefs
     std::vector<AttributeRef<int>> trackedAttrData;
     for (size_t tableIndex = 0; tableIndex < tableRefs.size(); tableIndex++)
     {
-        auto& table = tableRefs[tableIndex].get();
         trackedAttrData.emplace_back(mRelations[trackedRelIndices[tableIndex]][attr]);
     }
 
     // sort every range table
-    std::vector<std::vector<size_t>> sortIndices;
+    std::vector<std::vector<size_t>> sortIndices(tableRefs.size());
     // std::vector<std::vector<int>> sortAttrValueVec;
     Timer tim("sort");
+    ThreadPool::TaskGroup sortGroup(*mPool);
     for (size_t tableId = 0; tableId < tableRefs.size(); tableId++)
     {
         size_t trackedRelId = trackedRelIndices[tableId];
         auto& table = tableRefs[tableId].get();
-        sortIndices.emplace_back(table.LazySort(mRelations, trackedRelId, attr));
+        sortGroup.Run([&, tableId, trackedRelId]{ sortIndices[tableId] = table.LazySort(mRelations, trackedRelId, attr); });
 
         // std::vector<int> sortAttrValue(table.Length());
         // std::transform(sortIndices.back().begin(), sortIndices.back().end(), sortAttrValue.begin(),
@@ -792,17 +2229,47 @@ RangeTable GenericJoin::SingleAttrLoopJoin(std::vector<RangeTableRef>& tableRefs
 
         // sortAttrValueVec.push_back(sortAttrValue);
     }
+    sortGroup.Wait();
     // std::cout << "sorting time: " << tim.Timing() << std::endl;
 
 
     // find the shortest range table
-    int shortestRTIndex = 0;
-    for (int i = 0; i < sortIndices.size(); i++)
+    size_t shortestRTIndex = 0;
+    for (size_t i = 0; i < sortIndices.size(); i++)
     {
         if ( sortIndices[i].size() < sortIndices[shortestRTIndex].size() )
             shortestRTIndex = i;
     }
 
+    bool useMerge = mOptions.loopJoinMode == LoopJoinMode::Merge or (mPool->ThreadNum() > 1 and sortIndices[shortestRTIndex].size() > mOptions.morselSize);
+
+    // Adaptive: searching costs two indirect binary searches per table for every tuple of the
+    // shortest table, merging one cursor step per tuple, or two gallops per key of the shortest
+    // table in tables that MergeLoopJoin gallops in
+    if (mOptions.loopJoinMode == LoopJoinMode::Adaptive)
+    {
+        const size_t shortestLength = std::max<size_t>(sortIndices[shortestRTIndex].size(), 1);
+        double searchCost = 0, mergeCost = 0;
+        for (auto& sortIndex : sortIndices)
+        {
+            searchCost += 2.0 * shortestLength * std::bit_width(sortIndex.size()) * mCosts.indirectSearchStep;
+            if (sortIndex.size() > mOptions.gallopRatio * shortestLength)
+                mergeCost += 2.0 * shortestLength * std::bit_width(sortIndex.size() / shortestLength) * mCosts.gallopStep;
+            else
+                mergeCost += sortIndex.size() * mCosts.cursorStep;
+        }
+        useMerge = useMerge or mergeCost < searchCost;
+
+        if (mOptions.printStats)
+            LogStats("Loop join on " + attr + ": " + std::to_string(tableRefs.size()) + " tables, " + (useMerge ? "merge" : "search") +
+                     " (estimated search " + std::to_string(searchCost / 1e3) + "us, merge " + std::to_string(mergeCost / 1e3) + "us)");
+    }
+    else if (mOptions.printStats)
+        LogStats("Loop join on " + attr + ": " + std::to_string(tableRefs.size()) + " tables, " + (useMerge ? "merge" : "search"));
+
+    if (useMerge)
+        return MergeLoopJoin(tableRefs, trackedRelIndices, trackedAttrData, sortIndices);
+
     auto& shortestSortInd = sortIndices[shortestRTIndex];
     auto& shortestRangeTable = tableRefs[shortestRTIndex].get();
     auto& shortestAttrData = trackedAttrData[shortestRTIndex].get();
@@ -810,6 +2277,65 @@ RangeTable GenericJoin::SingleAttrLoopJoin(std::vector<RangeTableRef>& tableRefs
     RangeTable nextRangeTable = CreateFullEstimatedRangeTable(tableRefs, mRelations.size(), cost);
     std::vector<Range> rangeRange(tableRefs.size());
 
+    // merge the range tuples of the sorted runs in rangeRange
+    auto emitRanges = [&]{
+        RangeVecIterator iter(rangeRange);
+        while (iter)
+        {
+            auto rangeVec = iter.Get();
+            auto tuple = nextRangeTable.AcquireTuple();
+            for (size_t tableIndex = 0; tableIndex < tableRefs.size(); tableIndex++)
+            {
+                auto& table = tableRefs[tableIndex].get();
+                RangeTuple rangetuple = table[sortIndices[tableIndex][rangeVec[tableIndex]]];
+                for (auto relId : table.GetRelIndices())
+                    tuple[relId] = rangetuple[relId];
+            }
+            iter++;
+        }
+    };
+
+    // the same searches as ProbeSortedTables coroutines, up to ProbeChunkSize values interleaved at a time
+    if (mOptions.interleave > 0)
+    {
+        const size_t tableNum = tableRefs.size();
+        std::vector<SortedTableProbe> probes;
+        for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+            probes.push_back(SortedTableProbe{sortIndices[tableIndex].data(), sortIndices[tableIndex].size(), &tableRefs[tableIndex].get(),
+                                              trackedRelIndices[tableIndex], trackedAttrData[tableIndex].get().Raw().data()});
+
+        std::vector<int> values(ProbeChunkSize);
+        std::vector<Range> ranges(ProbeChunkSize * tableNum);
+        int preValue = -1;
+        size_t seq = 0;
+        while (seq < shortestSortInd.size())
+        {
+            size_t count = 0;
+            for (; seq < shortestSortInd.size() and count < ProbeChunkSize; seq++)
+            {
+                RangeTuple expectedTuple = shortestRangeTable[shortestSortInd[seq]];
+                int expectedValue = shortestAttrData[expectedTuple[trackedRelIndices[shortestRTIndex]].st];
+                if (expectedValue != preValue)
+                    values[count++] = expectedValue;
+                preValue = expectedValue;
+            }
+
+            Interleave(count, mOptions.interleave, [&](size_t b){
+                return ProbeSortedTables(probes.data(), tableNum, values[b], ranges.data() + b * tableNum);
+            });
+
+            for (size_t b = 0; b < count; b++)
+            {
+                if (!ranges[b * tableNum].Valid())
+                    continue;
+                std::copy_n(ranges.begin() + b * tableNum, tableNum, rangeRange.begin());
+                emitRanges();
+            }
+        }
+
+        return nextRangeTable;
+    }
+
     int preValue = -1;
     for (size_t seq = 0; seq < shortestSortInd.size(); seq++)
     {
@@ -858,22 +2384,7 @@ RangeTable GenericJoin::SingleAttrLoopJoin(std::vector<RangeTableRef>& tableRefs
 
         // merge
         if (valid)
-        {
-            RangeVecIterator iter(rangeRange);
-            while (iter)
-            {
-                auto rangeVec = iter.Get();
-                auto tuple = nextRangeTable.AcquireTuple();
-                for (size_t tableIndex = 0; tableIndex < tableRefs.size(); tableIndex++)
-                {
-                    auto& table = tableRefs[tableIndex].get();
-                    RangeTuple rangetuple = table[sortIndices[tableIndex][rangeVec[tableIndex]]];
-                    for (auto relId : table.GetRelIndices())
-                        tuple[relId] = rangetuple[relId];
-                }
-                iter++;
-            }
-        }
+            emitRanges();
 
         preValue = expectedValue;
     }
@@ -952,3 +2463,180 @@ RangeTable GenericJoin::SingleAttrLoopJoin(std::vector<RangeTableRef>& tableRefs
     return nextRangeTable;
 }
 
+// K-way sort-merge of the child tables. With several threads the sorted key domain is split at
+// sampled splitters and every key range is merged as its own task. Partitions are ordered by key,
+// so concatenating their outputs yields the same tuples in the same order as the serial loop.
+RangeTable GenericJoin::MergeLoopJoin(std::vector<RangeTableRef>& tableRefs, const std::vector<size_t>& trackedRelIndices,
+                                         std::vector<AttributeRef<int>>& trackedAttrData, const std::vector<std::vector<size_t>>& sortIndices)
+{
+    const size_t tableNum = tableRefs.size();
+
+    // join attribute of every table in sorted order
+    std::vector<std::vector<int>> sortedKeys(tableNum);
+    for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+    {
+        auto& table = tableRefs[tableIndex].get();
+        auto& attrData = trackedAttrData[tableIndex].get();
+        size_t trackedRelId = trackedRelIndices[tableIndex];
+
+        sortedKeys[tableIndex].resize(sortIndices[tableIndex].size());
+        for (size_t seq = 0; seq < sortIndices[tableIndex].size(); seq++)
+            sortedKeys[tableIndex][seq] = attrData[table[sortIndices[tableIndex][seq]][trackedRelId].st];
+    }
+
+    // tables much longer than the shortest one are galloped through, the others scanned linearly
+    size_t shortestLength = std::numeric_limits<size_t>::max();
+    for (auto& keys : sortedKeys)
+        shortestLength = std::min(shortestLength, keys.size());
+    std::vector<bool> gallop(tableNum);
+    for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+        gallop[tableIndex] = sortedKeys[tableIndex].size() > mOptions.gallopRatio * shortestLength;
+
+    if (mPool->ThreadNum() == 1 or shortestLength <= mOptions.morselSize)
+    {
+        std::vector<Range> bounds(tableNum);
+        for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+            bounds[tableIndex] = Range{0, sortedKeys[tableIndex].size()};
+
+        RangeTable nextRangeTable = CreateFullEstimatedRangeTable(tableRefs, mRelations.size(), 0);
+        MergeJoinKeyRange(tableRefs, sortIndices, sortedKeys, gallop, bounds, nextRangeTable);
+        return nextRangeTable;
+    }
+
+    // evenly spaced keys of every table approximate the quantiles of the joint key distribution
+    const size_t partitionNum = mPool->ThreadNum() * PartitionsPerThread;
+    std::vector<int> samples;
+    for (auto& keys : sortedKeys)
+    {
+        size_t step = std::max<size_t>(keys.size() / (partitionNum * SamplesPerPartition), 1);
+        for (size_t seq = step / 2; seq < keys.size(); seq += step)
+            samples.push_back(keys[seq]);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    std::vector<int> splitters;
+    for (size_t partition = 1; partition < partitionNum and !samples.empty(); partition++)
+        splitters.push_back(samples[partition * samples.size() / partitionNum]);
+    splitters.erase(std::unique(splitters.begin(), splitters.end()), splitters.end());
+
+    // partition p holds the keys in [splitters[p-1], splitters[p])
+    std::vector<std::vector<Range>> partitionBounds(splitters.size() + 1, std::vector<Range>(tableNum));
+    for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+    {
+        auto& keys = sortedKeys[tableIndex];
+        size_t st = 0;
+        for (size_t partition = 0; partition <= splitters.size(); partition++)
+        {
+            size_t ed = partition < splitters.size()
+                ? std::lower_bound(keys.begin() + st, keys.end(), splitters[partition]) - keys.begin()
+                : keys.size();
+            partitionBounds[partition][tableIndex] = Range{st, ed};
+            st = ed;
+        }
+    }
+
+    std::vector<RangeTable> chunks;
+    chunks.reserve(partitionBounds.size());
+    for (size_t partition = 0; partition < partitionBounds.size(); partition++)
+        chunks.emplace_back(mRelations.size(), 0);
+
+    mPool->ParallelFor(partitionBounds.size(), 1, [&](size_t, size_t st, size_t ed){
+        for (size_t partition = st; partition < ed; partition++)
+            MergeJoinKeyRange(tableRefs, sortIndices, sortedKeys, gallop, partitionBounds[partition], chunks[partition]);
+    });
+
+    size_t resultNum = 0;
+    for (auto& chunk : chunks)
+        resultNum += chunk.Length();
+
+    RangeTable nextRangeTable(mRelations.size(), resultNum);
+    for (auto& chunk : chunks)
+        nextRangeTable.Append(chunk);
+
+    return nextRangeTable;
+}
+
+// Leapfrog over the sorted keys of the child tables inside the given bounds. All cursors only move
+// forward, by exponential search in the tables marked in gallop and one step at a time otherwise.
+// Every common key emits the cartesian product of the matching range tuples of all tables.
+void GenericJoin::MergeJoinKeyRange(std::vector<RangeTableRef>& tableRefs, const std::vector<std::vector<size_t>>& sortIndices,
+                                    const std::vector<std::vector<int>>& sortedKeys, const std::vector<bool>& gallop,
+                                    std::vector<Range> bounds, RangeTable& nextRangeTable)
+{
+    const size_t tableNum = tableRefs.size();
+    for (auto& bound : bounds)
+        if (!bound.Valid())
+            return;
+
+    auto lowerBound = [&](size_t tableIndex, size_t from, int value){
+        auto& keys = sortedKeys[tableIndex];
+        if (gallop[tableIndex])
+            return GallopLowerBound(keys, from, bounds[tableIndex].ed, value);
+        while (from < bounds[tableIndex].ed and keys[from] < value)
+            from++;
+        return from;
+    };
+    auto upperBound = [&](size_t tableIndex, size_t from, int value){
+        auto& keys = sortedKeys[tableIndex];
+        if (gallop[tableIndex])
+            return GallopUpperBound(keys, from, bounds[tableIndex].ed, value);
+        while (from < bounds[tableIndex].ed and keys[from] == value)
+            from++;
+        return from;
+    };
+
+    std::vector<Range> rangeRange(tableNum);
+    int candidate = sortedKeys[0][bounds[0].st];
+    size_t agreed = 0;
+    size_t i = 0;
+    while (true)
+    {
+        auto& keys = sortedKeys[i];
+        bounds[i].st = lowerBound(i, bounds[i].st, candidate);
+        if (bounds[i].st == bounds[i].ed)
+            return;
+
+        if (keys[bounds[i].st] != candidate)
+        {
+            candidate = keys[bounds[i].st];
+            agreed = 1;
+            i = (i + 1) % tableNum;
+            continue;
+        }
+        if (++agreed < tableNum)
+        {
+            i = (i + 1) % tableNum;
+            continue;
+        }
+
+        bool exhausted = false;
+        for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+        {
+            size_t upper = upperBound(tableIndex, bounds[tableIndex].st, candidate);
+            rangeRange[tableIndex] = Range{bounds[tableIndex].st, upper};
+            bounds[tableIndex].st = upper;
+            exhausted = exhausted or upper == bounds[tableIndex].ed;
+        }
+
+        RangeVecIterator iter(rangeRange);
+        while (iter)
+        {
+            auto& rangeVec = iter.Get();
+            auto tuple = nextRangeTable.AcquireTuple();
+            for (size_t tableIndex = 0; tableIndex < tableNum; tableIndex++)
+            {
+                auto& table = tableRefs[tableIndex].get();
+                RangeTuple rangetuple = table[sortIndices[tableIndex][rangeVec[tableIndex]]];
+                for (auto relId : table.GetRelIndices())
+                    tuple[relId] = rangetuple[relId];
+            }
+            iter++;
+        }
+
+        if (exhausted)
+            return;
+
+        candidate = sortedKeys[i][bounds[i].st];
+        agreed = 0;
+    }
+}
@@ -1,23 +1,99 @@
 #pragma once
 
+#include "Aggregate.h"
+#include "Calibration.h"
+#include "Estimator.h"
+#include "IntersectCache.h"
 #include "Range.h"
 #include "Relation.h"
 #include "Plan.h"
+#include "ThreadPool.h"
 
+#include <array>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 
+enum class IntersectMode
+{
+    BinarySearch,   // lower/upper bound over the whole sub-range for every candidate
+    Galloping,      // leapfrog with forward-only cursors and exponential search
+    Simd,           // vectorized intersection of the ranges' distinct keys
+    Bitmap,         // Simd, with roaring bitmaps for ranges of at least bitmapThreshold keys
+    Batched,        // branchless binary searches of a batch of candidates in lockstep, with prefetch
+    Adaptive,       // one of the first four per range tuple, by a cost model over its range lengths
+};
+
+enum class JoinEngine
+{
+    Generic,        // GenericJoin over range tables
+    Leapfrog,       // LeapfrogTrieJoin over the GVO
+};
+
+enum class EHMergeMode
+{
+    Merge,          // forward-only galloping cursors over the sorted sub-tables
+    Hash,           // one probe of an open addressing index per composite key
+};
+
+enum class LoopJoinMode
+{
+    BinarySearch,   // binary search of every table for each distinct value of the shortest one
+    Merge,          // k-way sort-merge with forward-only cursors
+    Adaptive,       // one of the two per operator, by a cost model over the table lengths
+};
+
+struct JoinOptions
+{
+    JoinEngine engine = JoinEngine::Generic;
+    IntersectMode intersectMode = IntersectMode::BinarySearch;
+    size_t bitmapThreshold = 4096;
+    size_t batchSize = 32;
+    EHMergeMode ehMerge = EHMergeMode::Merge;
+    LoopJoinMode loopJoinMode = LoopJoinMode::BinarySearch;
+    size_t gallopRatio = 32;       // merge cursors gallop in tables this many times longer than the shortest
+    size_t heavyThreshold = 0;     // WCO range tuples with more candidate rows are split, 0 disables
+    bool specializeKernels = true; // use the kernels unrolled for 2..8 relations where they apply
+    size_t threadNum = 1;
+    size_t morselSize = 1024;      // range tuples per scheduling unit of the parallel operators
+    bool preserveOrder = false;    // emit parallel results in input order instead of per-thread chunks
+    size_t searchIndexThreshold = 0; // binary searches of ranges with at least this many rows use a k-ary index, 0 disables
+    std::string calibrationPath;   // calibrated costs of the adaptive modes are kept here, empty calibrates every run
+    bool printStats = false;       // print the strategies chosen per operator after the join
+    bool semiJoin = false;         // semi-join reduce the relations around every EH cut relation before the join
+    std::string lpSolver = "BUILTIN"; // LP solver of the optimizer's estimates, BUILTIN or an or-tools id such as GLOP
+    EstimateModel estimateModel = EstimateModel::Agm; // bound the optimizer estimates its candidates with
+    size_t sampleWalks = 1024;     // random walks per estimate of the sample and hybrid estimators, 0 for no limit
+    double sampleMillis = 0;       // milliseconds per estimate of the sample and hybrid estimators, 0 for no limit
+    std::string estimateCachePath;  // the optimizer's estimates are loaded from and saved to this file, empty keeps them for one run
+    std::vector<std::string> groupBy;      // group the results by these attributes and aggregate them
+    std::vector<AggregateSpec> aggregates; // aggregates per group, count if only groupBy is set
+    size_t limit = 0;              // stop after this many results, running the top WCO joins depth-first; 0 computes all
+    bool exists = false;           // only report whether any result exists (limit 1)
+    bool ordered = false;          // with a limit, return the first results in GVO order
+    std::vector<std::string> gvo;  // global variable order of the plan, needed by ordered
+    size_t intersectCacheBytes = 0; // memory of the per-thread intersection caches of every WCO join, 0 disables
+    size_t interleave = 0;         // probes in flight of the coroutine-interleaved binary search and hash lookups, 0 disables;
+                                   // in binary and adaptive mode it replaces the specialized binary-search kernels
+};
+
+
 class GenericJoin
 {
 public:
-    GenericJoin(std::unique_ptr<LTPlan> plan, std::vector<Relation>&& relations, std::vector<std::string>&& attrs)
-        : mPlan(std::move(plan)), mRelations(std::move(relations)), mAttrs(std::move(attrs))
+    GenericJoin(std::unique_ptr<LTPlan> plan, std::vector<Relation>&& relations, std::vector<std::string>&& attrs, JoinOptions options = {})
+        : mPlan(std::move(plan)), mRelations(std::move(relations)), mAttrs(std::move(attrs)), mOptions(options),
+          mPool(std::make_unique<ThreadPool>(options.threadNum))
     {}
 
     Relation operator()();
 
+    // Results of the last run, the number printed as "Join results number"
+    size_t ResultNum() const { return mResultNum; }
+
 private:
     std::vector<size_t> SelectRelationIndices(std::string_view attr, bool expect);
 
@@ -28,19 +104,128 @@ private:
 
     RangeTable SingleAttrWCOJoin(RangeTableRef tableRef, std::vector<size_t>& relIndices, std::string attr, double cost);
 
+    // Per operator scratch space of the intersection kernels
+    struct IntersectScratch
+    {
+        std::vector<size_t> cursors;
+        std::vector<size_t> runEnds;
+        std::vector<size_t> keyCursors;
+        std::vector<size_t> order;
+        std::vector<int> keys;
+        std::vector<int> swapKeys;
+        std::vector<int> candidates;
+        std::vector<std::shared_ptr<const RoaringBitmap>> bitmaps;
+        std::vector<Range> subTuple;
+        std::vector<int> batchValues;
+        std::vector<size_t> batchLowers;
+        std::vector<size_t> batchUppers;
+        std::vector<Range> batchRanges;     // relation count ranges per candidate
+        std::vector<const int*> probeColumns;
+        std::array<size_t, 4> strategyTuples{};    // range tuples per adaptively chosen IntersectMode
+        IntersectionCache cache;
+        std::vector<Range> cacheKey;
+        std::vector<Range> cacheResults;
+    };
+
+    // Part of the shortest range of a heavy range tuple, joined as a unit of work of its own
+    struct HeavyPiece
+    {
+        size_t relationIndex;
+        Range range;
+    };
+
+    IntersectMode SelectIntersectMode(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, std::vector<AttributeRef<int>>& attrsData);
+
+    IntersectScratch PrepareScratch(const std::vector<size_t>& relationIndices, std::vector<AttributeRef<int>>& attrsData);
+
+    void IntersectRangeTuple(IntersectMode mode, RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                             std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable);
+
+    // Appends the cached intersection of rangeTuple to out, false on a miss
+    bool AppendCachedResults(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, IntersectScratch& scratch, RangeTable& out);
+
+    // Caches out[first, out.Length()) as the intersection of rangeTuple
+    void CacheResults(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, IntersectScratch& scratch, RangeTable& out, size_t first);
+
+    void BinarySearchIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                               std::vector<AttributeRef<int>>& attrsData, RangeTable& nextRangeTable);
+
+    void BatchedIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices,
+                          std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable);
+
+    void InterleavedIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices,
+                              IntersectScratch& scratch, RangeTable& nextRangeTable);
+
+    void GallopingIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                            std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable);
+
+    void SimdIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                       std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable);
+
+    void BitmapIntersect(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                         std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch, RangeTable& nextRangeTable);
+
+    void EmitCommonKeys(RangeTuple rangeTuple, const std::vector<size_t>& relationIndices, const std::vector<size_t>& relationIndicesC,
+                        std::vector<AttributeRef<int>>& attrsData, IntersectScratch& scratch,
+                        const int* common, size_t commonNum, RangeTable& nextRangeTable);
+
     RangeTable SingleAttrLoopJoin(std::vector<RangeTableRef>& tableRefs, std::vector<size_t>& relIndices, std::string attr, double cost);
 
+    RangeTable MergeLoopJoin(std::vector<RangeTableRef>& tableRefs, const std::vector<size_t>& trackedRelIndices,
+                             std::vector<AttributeRef<int>>& trackedAttrData, const std::vector<std::vector<size_t>>& sortIndices);
+
+    void MergeJoinKeyRange(std::vector<RangeTableRef>& tableRefs, const std::vector<std::vector<size_t>>& sortIndices,
+                           const std::vector<std::vector<int>>& sortedKeys, const std::vector<bool>& gallop,
+                           std::vector<Range> bounds, RangeTable& nextRangeTable);
+
     RangeTable SingleAttrCartesianJoin(std::vector<RangeTableRef>& tableRefs, double cost);
 
     void PrintEqTable(RangeTable& rangeTable, const std::vector<std::string>& attrs);
 
+    void BuildSearchIndexes(Relation& relation);
+
+    void LogStats(std::string line);
+
     RangeTable Execute(std::unique_ptr<LTPlan> plan);
 
+    void SemiJoinReduce(LTPlan& plan);
+
+    // One single-attribute WCO join run depth-first, with the results of the current tuple
+    struct PipelineLevel
+    {
+        std::vector<size_t> relationIndices;
+        std::vector<size_t> relationIndicesC;
+        std::vector<AttributeRef<int>> attrsData;
+        IntersectScratch scratch;
+        RangeTable results{0, 0};
+    };
+
+    std::unique_ptr<LTPlan> PeelTopJoins(std::unique_ptr<LTPlan> plan, std::vector<std::unique_ptr<LTPlan>>& chain,
+                                         const std::function<bool(const std::string&)>& take);
+
+    RangeTable ExecuteBelowPipeline(std::unique_ptr<LTPlan> plan);
+
+    std::vector<PipelineLevel> PreparePipeline(std::vector<std::unique_ptr<LTPlan>>& chain);
+
+    // Number of results of tuple on the level, which are in level.results unless countOnly is set
+    // and they came from the cache
+    size_t IntersectLevel(PipelineLevel& level, RangeTuple tuple, bool countOnly = false);
+
+    RangeTable ExecutePipelined(std::unique_ptr<LTPlan> plan, size_t limit);
+
+    GroupTable ExecuteAggregate(std::unique_ptr<LTPlan> plan, uint64_t& resultNum);
+
+    std::vector<RangeTable> ExecuteSubPlans(std::vector<std::unique_ptr<LTPlan>>&& subPlans);
+
     RangeTable ExecuteMuti(std::unique_ptr<LTPlan> plan);
 
     RangeTable ExecuteSingle(std::unique_ptr<LTPlan> plan);
 
-    RangeTable ExecuteEH(std::unique_ptr<LTPlan> plan);
+    // Called per matching run of the EH merge with the cut relation row and the matching range of
+    // every sorted sub-table, instead of emitting the run's product
+    using EHRunVisitor = std::function<void(size_t jrTupleId, const Range* matches, size_t tableNum)>;
+
+    RangeTable ExecuteEH(std::unique_ptr<LTPlan> plan, const EHRunVisitor& visitRun = nullptr);
 
     RangeTable ExecuteCartesian(std::unique_ptr<LTPlan> plan);
 
@@ -49,6 +234,13 @@ private:
     std::unique_ptr<LTPlan> mPlan;
     std::vector<Relation> mRelations;
     std::vector<std::string> mAttrs;
+    JoinOptions mOptions;
+    std::unique_ptr<ThreadPool> mPool;
+
+    IntersectCosts mCosts;
+    size_t mResultNum = 0;
+    std::mutex mStatsMutex;
+    std::vector<std::string> mStats;
 };
 
 
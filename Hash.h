@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Range.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Hashes of composite keys for the hash tables and caches of the joins. Every word of the key is
+// folded in with a multiplicative step seeded by the key width, and the murmur3 finalizer spreads
+// the result so that its low bits can index power-of-two slot arrays directly.
+
+inline uint64_t MixHash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+inline uint64_t FoldHash(uint64_t hash, uint64_t word)
+{
+    return (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+}
+
+inline uint64_t HashKey(const int* key, size_t keyWidth)
+{
+    uint64_t hash = keyWidth;
+    for (size_t i = 0; i < keyWidth; i++)
+        hash = FoldHash(hash, static_cast<uint32_t>(key[i]));
+    return MixHash(hash);
+}
+
+inline uint64_t HashKey(const Range* key, size_t keyWidth)
+{
+    uint64_t hash = keyWidth;
+    for (size_t i = 0; i < keyWidth; i++)
+    {
+        hash = FoldHash(hash, key[i].st);
+        hash = FoldHash(hash, key[i].ed);
+    }
+    return MixHash(hash);
+}
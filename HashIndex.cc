@@ -0,0 +1,127 @@
+#include "HashIndex.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+CompositeKeyTable::CompositeKeyTable(size_t keyWidth, size_t expectedKeyNum)
+    : mKeyWidth(keyWidth), mEntryNum(0), mMask(0)
+{
+    mKeys.reserve(expectedKeyNum * keyWidth);
+
+    size_t slotNum = 16;
+    while (slotNum < expectedKeyNum * 2)
+        slotNum <<= 1;
+    Rehash(slotNum);
+}
+
+
+void CompositeKeyTable::Rehash(size_t slotNum)
+{
+    mSlots.assign(slotNum, 0);
+    mMask = slotNum - 1;
+
+    for (size_t entry = 0; entry < mEntryNum; entry++)
+    {
+        size_t slot = Hash(Key(entry)) & mMask;
+        while (mSlots[slot] != 0)
+            slot = (slot + 1) & mMask;
+        mSlots[slot] = entry + 1;
+    }
+}
+
+
+size_t CompositeKeyTable::Find(const int* key) const
+{
+    size_t slot = Hash(key) & mMask;
+    while (mSlots[slot] != 0)
+    {
+        size_t entry = mSlots[slot] - 1;
+        if (std::equal(key, key + mKeyWidth, Key(entry)))
+            return entry;
+        slot = (slot + 1) & mMask;
+    }
+
+    return NoEntry;
+}
+
+
+size_t CompositeKeyTable::Insert(const int* key, bool& inserted)
+{
+    size_t slot = Hash(key) & mMask;
+    while (mSlots[slot] != 0)
+    {
+        size_t entry = mSlots[slot] - 1;
+        if (std::equal(key, key + mKeyWidth, Key(entry)))
+        {
+            inserted = false;
+            return entry;
+        }
+        slot = (slot + 1) & mMask;
+    }
+
+    if (mEntryNum == std::numeric_limits<uint32_t>::max())
+        throw std::length_error("Composite key table holds more than 2^32 - 1 keys");
+
+    // keep the load factor at most one half
+    if ((mEntryNum + 1) * 2 > mSlots.size())
+    {
+        Rehash(mSlots.size() * 2);
+        slot = Hash(key) & mMask;
+        while (mSlots[slot] != 0)
+            slot = (slot + 1) & mMask;
+    }
+
+    mSlots[slot] = ++mEntryNum;
+    mKeys.insert(mKeys.end(), key, key + mKeyWidth);
+    inserted = true;
+    return mEntryNum - 1;
+}
+
+
+void CompositeKeyTable::PrefetchSlot(const int* key) const
+{
+    __builtin_prefetch(mSlots.data() + (Hash(key) & mMask));
+}
+
+
+size_t CompositeKeyTable::PrefetchEntry(const int* key) const
+{
+    uint32_t slot = mSlots[Hash(key) & mMask];
+    if (slot == 0)
+        return NoEntry;
+    __builtin_prefetch(Key(slot - 1));
+    return slot - 1;
+}
+
+
+CompositeKeyIndex::CompositeKeyIndex(size_t keyWidth, size_t expectedKeyNum)
+    : mTable(keyWidth, expectedKeyNum)
+{
+    mRanges.reserve(expectedKeyNum);
+}
+
+
+void CompositeKeyIndex::Insert(const int* key, Range range)
+{
+    bool inserted;
+    mTable.Insert(key, inserted);
+    if (inserted)
+        mRanges.push_back(range);
+}
+
+
+void CompositeKeyIndex::PrefetchEntry(const int* key) const
+{
+    size_t entry = mTable.PrefetchEntry(key);
+    if (entry != CompositeKeyTable::NoEntry)
+        __builtin_prefetch(mRanges.data() + entry);
+}
+
+
+const Range* CompositeKeyIndex::Find(const int* key) const
+{
+    size_t entry = mTable.Find(key);
+    return entry == CompositeKeyTable::NoEntry ? nullptr : &mRanges[entry];
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Hash.h"
+#include "Range.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Open addressing hash table of composite keys of keyWidth ints. Keys are stored packed next to
+// each other in insertion order, so the entry index of a key addresses the values its owner keeps
+// in arrays of its own. Slots hold entry indices and are probed linearly.
+class CompositeKeyTable
+{
+public:
+    static constexpr size_t NoEntry = SIZE_MAX;
+
+    explicit CompositeKeyTable(size_t keyWidth, size_t expectedKeyNum = 0);
+
+    // entry of the key, NoEntry if absent
+    size_t Find(const int* key) const;
+
+    // entry of the key, appended if absent; inserted tells which
+    size_t Insert(const int* key, bool& inserted);
+
+    void PrefetchSlot(const int* key) const;
+
+    // prefetches the stored key the slot of key points to and returns its entry, NoEntry if the
+    // slot is empty
+    size_t PrefetchEntry(const int* key) const;
+
+    const int* Key(size_t entry) const { return mKeys.data() + entry * mKeyWidth; }
+
+    size_t KeyWidth() const { return mKeyWidth; }
+
+    size_t Size() const { return mEntryNum; }
+
+private:
+    uint64_t Hash(const int* key) const { return HashKey(key, mKeyWidth); }
+
+    void Rehash(size_t slotNum);
+
+private:
+    size_t mKeyWidth;
+    std::vector<int> mKeys;          // mKeyWidth ints per entry
+    std::vector<uint32_t> mSlots;    // entry index + 1, 0 marks an empty slot; Insert throws past 2^32 - 1 entries
+    size_t mEntryNum;
+    size_t mMask;
+};
+
+
+// Hash index from composite keys of keyWidth ints to ranges [st, ed) of a sorted sequence, so
+// that all matches of a key are one contiguous list; every key is inserted at most once.
+class CompositeKeyIndex
+{
+public:
+    explicit CompositeKeyIndex(size_t keyWidth, size_t expectedKeyNum = 0);
+
+    // ignored if the key is present
+    void Insert(const int* key, Range range);
+
+    // nullptr if the key is absent
+    const Range* Find(const int* key) const;
+
+    // Interleaved lookups call PrefetchSlot, PrefetchEntry once the slot arrived, then Find, so
+    // that the slot and the entry miss while other lookups run
+    void PrefetchSlot(const int* key) const { mTable.PrefetchSlot(key); }
+
+    void PrefetchEntry(const int* key) const;
+
+    size_t Size() const { return mRanges.size(); }
+
+private:
+    CompositeKeyTable mTable;
+    std::vector<Range> mRanges;      // per entry of mTable
+};
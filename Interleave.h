@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <utility>
+#include <vector>
+
+
+// Probes written as coroutines that suspend right after prefetching the next address they read,
+// and a round-robin scheduler that keeps a window of independent probes in flight. While one
+// probe waits for its cache line the others run, so the misses of a window overlap.
+
+// Coroutine frames of the probes are recycled through per-thread free lists of 64 byte size
+// classes, as every probe allocates one.
+class ProbeFramePool
+{
+public:
+    static void* Allocate(size_t size)
+    {
+        size_t sizeClass = (size + 63) / 64;
+        auto& lists = Lists().free;
+        if (sizeClass < lists.size() and !lists[sizeClass].empty())
+        {
+            void* frame = lists[sizeClass].back();
+            lists[sizeClass].pop_back();
+            return frame;
+        }
+        return ::operator new(sizeClass * 64);
+    }
+
+    static void Free(void* frame, size_t size)
+    {
+        size_t sizeClass = (size + 63) / 64;
+        auto& lists = Lists().free;
+        if (sizeClass < lists.size())
+            lists[sizeClass].push_back(frame);
+        else
+            ::operator delete(frame);
+    }
+
+private:
+    struct FreeLists
+    {
+        std::array<std::vector<void*>, 16> free;
+
+        ~FreeLists()
+        {
+            for (auto& list : free)
+                for (void* frame : list)
+                    ::operator delete(frame);
+        }
+    };
+
+    static FreeLists& Lists()
+    {
+        thread_local FreeLists lists;
+        return lists;
+    }
+};
+
+
+// A probe: created suspended, resumed by Interleave until done. Results are written through the
+// pointers it was created with.
+class ProbeTask
+{
+public:
+    struct promise_type
+    {
+        ProbeTask get_return_object() { return ProbeTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void* operator new(size_t size) { return ProbeFramePool::Allocate(size); }
+        static void operator delete(void* frame, size_t size) { ProbeFramePool::Free(frame, size); }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    ProbeTask(ProbeTask&& other) noexcept
+        : mHandle(std::exchange(other.mHandle, {}))
+    {}
+
+    ~ProbeTask()
+    {
+        if (mHandle)
+            mHandle.destroy();
+    }
+
+    Handle Release() { return std::exchange(mHandle, {}); }
+
+private:
+    explicit ProbeTask(Handle handle)
+        : mHandle(handle)
+    {}
+
+    Handle mHandle;
+};
+
+
+// co_await Prefetch{address} starts loading the cache line of address and yields to the other probes
+struct Prefetch
+{
+    const void* address;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<>) const noexcept { __builtin_prefetch(address); }
+    void await_resume() const noexcept {}
+};
+
+
+constexpr size_t MaxInterleave = 64;
+
+// Runs the probes makeProbe(0) .. makeProbe(probeNum - 1), at most width of them at a time,
+// resuming the active ones round-robin. A finished probe's slot goes to the next probe.
+template<typename MakeProbe>
+void Interleave(size_t probeNum, size_t width, MakeProbe&& makeProbe)
+{
+    width = std::clamp<size_t>(width, 1, MaxInterleave);
+    std::array<ProbeTask::Handle, MaxInterleave> slots;
+
+    size_t next = 0, active = 0;
+    for (; active < width and next < probeNum; active++)
+        slots[active] = makeProbe(next++).Release();
+
+    while (active > 0)
+    {
+        for (size_t slot = 0; slot < active; )
+        {
+            slots[slot].resume();
+            if (!slots[slot].done())
+            {
+                slot++;
+                continue;
+            }
+
+            slots[slot].destroy();
+            if (next < probeNum)
+                slots[slot++] = makeProbe(next++).Release();
+            else
+                slots[slot] = slots[--active];
+        }
+    }
+}
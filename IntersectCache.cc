@@ -0,0 +1,118 @@
+#include "IntersectCache.h"
+
+#include <algorithm>
+
+
+namespace
+{
+
+// bookkeeping per entry besides its ranges: the vectors, flags and the index node
+constexpr size_t EntryOverhead = 96;
+
+constexpr size_t WarmupLookups = 4096;
+constexpr size_t MinHitInterval = 16;
+
+} // namespace
+
+
+IntersectionCache::IntersectionCache(size_t keyWidth, size_t budgetBytes)
+    : mKeyWidth(keyWidth), mBudgetBytes(budgetBytes), mBytes(0), mHand(0), mBypassed(false), mHits(0), mMisses(0), mEvictions(0)
+{
+}
+
+
+size_t IntersectionCache::Footprint(const Entry& entry) const
+{
+    return (entry.key.size() + entry.results.size()) * sizeof(Range) + EntryOverhead;
+}
+
+
+bool IntersectionCache::Find(const Range* key, const Range*& results, size_t& resultNum)
+{
+    if (mBypassed)
+    {
+        mMisses++;
+        return false;
+    }
+
+    auto iter = mIndex.find(Hash(key));
+    if (iter != mIndex.end())
+    {
+        Entry& entry = mEntries[iter->second];
+        bool equal = std::equal(entry.key.begin(), entry.key.end(), key, [](const Range& r1, const Range& r2){
+            return r1.st == r2.st and r1.ed == r2.ed;
+        });
+        if (equal)
+        {
+            mHits++;
+            entry.referenced = true;
+            results = entry.results.data();
+            resultNum = entry.results.size() / std::max<size_t>(mKeyWidth, 1);
+            return true;
+        }
+    }
+
+    mMisses++;
+    if (mHits + mMisses == WarmupLookups and mHits * MinHitInterval < WarmupLookups)
+    {
+        mBypassed = true;
+        mIndex.clear();
+        mEntries.clear();
+        mFreeEntries.clear();
+        mBytes = 0;
+    }
+    return false;
+}
+
+
+void IntersectionCache::Evict(size_t entryIndex)
+{
+    Entry& entry = mEntries[entryIndex];
+    mBytes -= Footprint(entry);
+    mIndex.erase(Hash(entry.key.data()));
+    entry = Entry{};
+    mFreeEntries.push_back(entryIndex);
+    mEvictions++;
+}
+
+
+void IntersectionCache::Insert(const Range* key, const Range* results, size_t resultNum)
+{
+    const size_t footprint = (mKeyWidth + resultNum * mKeyWidth) * sizeof(Range) + EntryOverhead;
+    if (!Enabled() or mBypassed or footprint * 4 > mBudgetBytes)
+        return;
+
+    const uint64_t hash = Hash(key);
+    auto iter = mIndex.find(hash);
+    if (iter != mIndex.end())
+        Evict(iter->second);
+
+    // CLOCK: sweep the entries, sparing and unmarking the ones referenced since the last sweep
+    while (mBytes + footprint > mBudgetBytes)
+    {
+        mHand = mHand < mEntries.size() ? mHand : 0;
+        Entry& entry = mEntries[mHand];
+        if (entry.used and entry.referenced)
+            entry.referenced = false;
+        else if (entry.used)
+            Evict(mHand);
+        mHand++;
+    }
+
+    size_t entryIndex = mEntries.size();
+    if (!mFreeEntries.empty())
+    {
+        entryIndex = mFreeEntries.back();
+        mFreeEntries.pop_back();
+    }
+    else
+        mEntries.emplace_back();
+
+    Entry& entry = mEntries[entryIndex];
+    entry.key.assign(key, key + mKeyWidth);
+    entry.results.assign(results, results + resultNum * mKeyWidth);
+    entry.used = true;
+    entry.referenced = false;
+    mIndex[hash] = entryIndex;
+    mBytes += footprint;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Hash.h"
+#include "Range.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+// Bounded cache of the intersections of one WCO join level, as in cached LFTJ. The key is the
+// ranges of the relations taking part in the level; the value lists, for every value in the
+// intersection, the ranges those relations narrow to, keyWidth ranges per value. Range tuples that
+// agree on the participating ranges intersect to the same values, so they can share the result.
+// Entries are evicted with the CLOCK policy once their footprint exceeds the byte budget. A cache
+// that hits less than once in MinHitInterval of its first WarmupLookups lookups stops caching, as
+// the keys of its level hardly repeat.
+class IntersectionCache
+{
+public:
+    IntersectionCache(size_t keyWidth = 0, size_t budgetBytes = 0);
+
+    bool Enabled() const { return mBudgetBytes > 0; }
+
+    // On a hit, points results to the resultNum cached groups of keyWidth ranges of key
+    bool Find(const Range* key, const Range*& results, size_t& resultNum);
+
+    // Results larger than a quarter of the budget are not kept
+    void Insert(const Range* key, const Range* results, size_t resultNum);
+
+    size_t Hits() const { return mHits; }
+
+    size_t Misses() const { return mMisses; }
+
+    size_t Evictions() const { return mEvictions; }
+
+    bool Bypassed() const { return mBypassed; }
+
+private:
+    struct Entry
+    {
+        std::vector<Range> key;
+        std::vector<Range> results;
+        bool used = false;
+        bool referenced = false;
+    };
+
+    uint64_t Hash(const Range* key) const { return HashKey(key, mKeyWidth); }
+
+    size_t Footprint(const Entry& entry) const;
+
+    void Evict(size_t entryIndex);
+
+private:
+    size_t mKeyWidth;
+    size_t mBudgetBytes;
+    size_t mBytes;
+    std::unordered_map<uint64_t, size_t> mIndex;    // key hash to entry, a colliding key replaces the entry
+    std::vector<Entry> mEntries;
+    std::vector<size_t> mFreeEntries;
+    size_t mHand;
+    bool mBypassed;
+
+    size_t mHits;
+    size_t mMisses;
+    size_t mEvictions;
+};
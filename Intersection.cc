@@ -0,0 +1,280 @@
+#include "Intersection.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INTERSECT_X86 1
+#endif
+
+
+namespace
+{
+
+// Switch to galloping once the larger side is this many times longer than the smaller one
+constexpr size_t GallopRatio = 32;
+
+
+size_t IntersectScalar(const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    size_t i = 0, j = 0, count = 0;
+    while (i < na and j < nb)
+    {
+        if (a[i] < b[j])
+            i++;
+        else if (a[i] > b[j])
+            j++;
+        else
+        {
+            out[count++] = a[i];
+            i++;
+            j++;
+        }
+    }
+
+    return count;
+}
+
+size_t EmitMatches(const int* a, unsigned bits, int* out)
+{
+    size_t count = 0;
+    while (bits)
+    {
+        out[count++] = a[__builtin_ctz(bits)];
+        bits &= bits - 1;
+    }
+
+    return count;
+}
+
+bool ProbeScalar(const int* block, size_t width, int value)
+{
+    for (size_t i = 0; i < width; i++)
+        if (block[i] == value)
+            return true;
+    return false;
+}
+
+// Gallop through large for every value of small, narrow the bracket down to less than Width
+// values and compare that block at once with probe.
+template<size_t Width>
+size_t IntersectGallop(const int* small, size_t ns, const int* large, size_t nl, int* out, bool (*probe)(const int*, int))
+{
+    size_t j = 0, count = 0;
+    for (size_t i = 0; i < ns and j < nl; i++)
+    {
+        int value = small[i];
+
+        // values before lo are less than value, and the first one not less is at or before hi
+        size_t lo = j, hi = j, step = 1;
+        while (hi < nl and large[hi] < value)
+        {
+            lo = hi + 1;
+            hi += step;
+            step <<= 1;
+        }
+        hi = std::min(hi, nl);
+
+        while (hi - lo >= Width)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (large[mid] < value)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        bool found = lo + Width <= nl ? probe(large + lo, value) : ProbeScalar(large + lo, nl - lo, value);
+        if (found)
+            out[count++] = value;
+        j = lo;
+    }
+
+    return count;
+}
+
+bool ProbeScalarBlock(const int* block, int value)
+{
+    return ProbeScalar(block, 4, value);
+}
+
+
+#ifdef INTERSECT_X86
+
+__attribute__((target("sse2")))
+size_t IntersectSSE(const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    size_t i = 0, j = 0, count = 0;
+    while (i + 4 <= na and j + 4 <= nb)
+    {
+        int aLast = a[i + 3], bLast = b[j + 3];
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+        // compare against the four rotations of vb
+        __m128i mask = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)))));
+        count += EmitMatches(a + i, _mm_movemask_ps(_mm_castsi128_ps(mask)), out + count);
+
+        if (aLast <= bLast)
+            i += 4;
+        if (bLast <= aLast)
+            j += 4;
+    }
+
+    return count + IntersectScalar(a + i, na - i, b + j, nb - j, out + count);
+}
+
+__attribute__((target("sse2")))
+bool ProbeSSE(const int* block, int value)
+{
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_set1_epi32(value)))) != 0;
+}
+
+__attribute__((target("avx2")))
+size_t IntersectAVX2(const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+
+    size_t i = 0, j = 0, count = 0;
+    while (i + 8 <= na and j + 8 <= nb)
+    {
+        int aLast = a[i + 7], bLast = b[j + 7];
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+
+        __m256i mask = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; r++)
+        {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            mask = _mm256_or_si256(mask, _mm256_cmpeq_epi32(va, vb));
+        }
+        count += EmitMatches(a + i, _mm256_movemask_ps(_mm256_castsi256_ps(mask)), out + count);
+
+        if (aLast <= bLast)
+            i += 8;
+        if (bLast <= aLast)
+            j += 8;
+    }
+
+    return count + IntersectScalar(a + i, na - i, b + j, nb - j, out + count);
+}
+
+__attribute__((target("avx2")))
+bool ProbeAVX2(const int* block, int value)
+{
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_set1_epi32(value)))) != 0;
+}
+
+__attribute__((target("avx512f")))
+size_t IntersectAVX512(const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    const __m512i rotate = _mm512_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0);
+
+    size_t i = 0, j = 0, count = 0;
+    while (i + 16 <= na and j + 16 <= nb)
+    {
+        int aLast = a[i + 15], bLast = b[j + 15];
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + j);
+
+        __mmask16 mask = _mm512_cmpeq_epi32_mask(va, vb);
+        for (int r = 1; r < 16; r++)
+        {
+            vb = _mm512_permutexvar_epi32(rotate, vb);
+            mask |= _mm512_cmpeq_epi32_mask(va, vb);
+        }
+        _mm512_mask_compressstoreu_epi32(out + count, mask, va);
+        count += __builtin_popcount(mask);
+
+        if (aLast <= bLast)
+            i += 16;
+        if (bLast <= aLast)
+            j += 16;
+    }
+
+    return count + IntersectScalar(a + i, na - i, b + j, nb - j, out + count);
+}
+
+__attribute__((target("avx512f")))
+bool ProbeAVX512(const int* block, int value)
+{
+    return _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(block), _mm512_set1_epi32(value)) != 0;
+}
+
+#endif
+
+} // namespace
+
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef INTERSECT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SimdLevel::SSE;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char* SimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::SSE:
+        return "SSE";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX512";
+    default:
+        return "Scalar";
+    }
+}
+
+size_t IntersectSorted(const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    static const SimdLevel level = DetectSimdLevel();
+    return IntersectSorted(level, a, na, b, nb, out);
+}
+
+size_t IntersectSorted(SimdLevel level, const int* a, size_t na, const int* b, size_t nb, int* out)
+{
+    static const SimdLevel supported = DetectSimdLevel();
+    level = std::min(level, supported);
+
+    if (na > nb)
+    {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    if (na == 0)
+        return 0;
+
+    bool gallop = nb / na >= GallopRatio;
+
+#ifdef INTERSECT_X86
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+        return gallop ? IntersectGallop<16>(a, na, b, nb, out, ProbeAVX512) : IntersectAVX512(a, na, b, nb, out);
+    case SimdLevel::AVX2:
+        return gallop ? IntersectGallop<8>(a, na, b, nb, out, ProbeAVX2) : IntersectAVX2(a, na, b, nb, out);
+    case SimdLevel::SSE:
+        return gallop ? IntersectGallop<4>(a, na, b, nb, out, ProbeSSE) : IntersectSSE(a, na, b, nb, out);
+    default:
+        break;
+    }
+#endif
+
+    return gallop ? IntersectGallop<4>(a, na, b, nb, out, ProbeScalarBlock) : IntersectScalar(a, na, b, nb, out);
+}
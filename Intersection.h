@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+
+// Intersection kernels for sorted arrays of distinct int32 values. The widest kernel the CPU
+// supports is detected once with CPUID; all kernels produce exactly the scalar merge's output.
+enum class SimdLevel
+{
+    Scalar,
+    SSE,        // 4x4 block compare
+    AVX2,       // 8x8 block compare
+    AVX512,     // 16x16 block compare
+};
+
+SimdLevel DetectSimdLevel();
+
+const char* SimdLevelName(SimdLevel level);
+
+// Writes a ∩ b to out, which must have room for min(na, nb) values and must not alias a or b.
+// Returns the number of values written.
+size_t IntersectSorted(const int* a, size_t na, const int* b, size_t nb, int* out);
+
+size_t IntersectSorted(SimdLevel level, const int* a, size_t na, const int* b, size_t nb, int* out);
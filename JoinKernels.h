@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Range.h"
+#include "Relation.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+
+// Intersection kernels of SingleAttrWCOJoin specialized on the number of participating relations.
+// Indices and columns live in std::array so the per-relation loops unroll, and an output tuple
+// starts as a copy of the input tuple, which covers the relations that do not take part.
+template<size_t RelNum>
+struct FixedIntersect
+{
+    std::array<size_t, RelNum> relationIndices;
+    std::array<const int*, RelNum> columns;
+    std::array<const Attribute<int>*, RelNum> attributes;
+    size_t width;
+
+    void BinarySearch(RangeTuple rangeTuple, RangeTable& nextRangeTable) const;
+
+    void Galloping(RangeTuple rangeTuple, RangeTable& nextRangeTable) const;
+
+private:
+    void Emit(RangeTuple rangeTuple, const std::array<Range, RelNum>& ranges, RangeTable& nextRangeTable) const
+    {
+        RangeTuple storeTuple = nextRangeTable.AcquireTuple();
+        std::copy_n(rangeTuple, width, storeTuple);
+        for (size_t i = 0; i < RelNum; i++)
+            storeTuple[relationIndices[i]] = ranges[i];
+    }
+};
+
+template<size_t RelNum>
+void FixedIntersect<RelNum>::BinarySearch(RangeTuple rangeTuple, RangeTable& nextRangeTable) const
+{
+    std::array<Range, RelNum> ranges;
+    size_t shortest = 0;
+    for (size_t i = 0; i < RelNum; i++)
+    {
+        ranges[i] = rangeTuple[relationIndices[i]];
+        if (ranges[i].Length() < ranges[shortest].Length())
+            shortest = i;
+    }
+
+    const int* base = columns[shortest];
+    std::array<Range, RelNum> found;
+    for (size_t index = ranges[shortest].st; index < ranges[shortest].ed; index++)
+    {
+        int value = base[index];
+        if (index != ranges[shortest].st and value == base[index - 1])
+            continue;
+
+        bool valueExist = true;
+        for (size_t i = 0; i < RelNum and valueExist; i++)
+        {
+            // both bounds over the whole range, as Attribute::Query searches them, so that the
+            // kernel agrees with BinarySearchIntersect on every range tuple
+            size_t lower = attributes[i]->LowerBound(ranges[i].st, ranges[i].ed, value);
+            size_t upper = attributes[i]->UpperBound(ranges[i].st, ranges[i].ed, value);
+            found[i] = Range{lower, upper};
+            valueExist = lower != upper;
+        }
+
+        if (valueExist)
+            Emit(rangeTuple, found, nextRangeTable);
+    }
+}
+
+template<size_t RelNum>
+void FixedIntersect<RelNum>::Galloping(RangeTuple rangeTuple, RangeTable& nextRangeTable) const
+{
+    std::array<size_t, RelNum> cursors, ends;
+    for (size_t i = 0; i < RelNum; i++)
+    {
+        cursors[i] = rangeTuple[relationIndices[i]].st;
+        ends[i] = rangeTuple[relationIndices[i]].ed;
+        if (cursors[i] >= ends[i])
+            return;
+    }
+
+    std::array<Range, RelNum> found;
+    int candidate = columns[0][cursors[0]];
+    size_t agreed = 0;
+    size_t i = 0;
+    while (true)
+    {
+        cursors[i] = GallopLowerBound(columns[i], cursors[i], ends[i], candidate);
+        if (cursors[i] == ends[i])
+            return;
+
+        int value = columns[i][cursors[i]];
+        if (value != candidate)
+        {
+            candidate = value;
+            agreed = 1;
+            i = i + 1 == RelNum ? 0 : i + 1;
+            continue;
+        }
+        if (++agreed < RelNum)
+        {
+            i = i + 1 == RelNum ? 0 : i + 1;
+            continue;
+        }
+
+        bool exhausted = false;
+        for (size_t j = 0; j < RelNum; j++)
+        {
+            size_t upper = GallopUpperBound(columns[j], cursors[j], ends[j], candidate);
+            found[j] = Range{cursors[j], upper};
+            cursors[j] = upper;
+            exhausted = exhausted or upper == ends[j];
+        }
+        Emit(rangeTuple, found, nextRangeTable);
+
+        if (exhausted)
+            return;
+        candidate = columns[i][cursors[i]];
+        agreed = 0;
+    }
+}
+
+
+using TupleKernel = std::function<void(RangeTuple, RangeTable&)>;
+
+template<size_t RelNum>
+TupleKernel MakeFixedKernel(const std::vector<size_t>& relationIndices, std::vector<AttributeRef<int>>& attrsData, size_t width, bool galloping)
+{
+    FixedIntersect<RelNum> kernel;
+    for (size_t i = 0; i < RelNum; i++)
+    {
+        kernel.relationIndices[i] = relationIndices[i];
+        kernel.columns[i] = attrsData[i].get().Raw().data();
+        kernel.attributes[i] = &attrsData[i].get();
+    }
+    kernel.width = width;
+
+    if (galloping)
+        return [kernel](RangeTuple rangeTuple, RangeTable& nextRangeTable){ kernel.Galloping(rangeTuple, nextRangeTable); };
+    return [kernel](RangeTuple rangeTuple, RangeTable& nextRangeTable){ kernel.BinarySearch(rangeTuple, nextRangeTable); };
+}
+
+// Kernel specialized for relationIndices.size() relations, empty when there is none (fewer than
+// 2 or more than 8 relations) and the generic kernels have to be used.
+inline TupleKernel SelectFixedKernel(const std::vector<size_t>& relationIndices, std::vector<AttributeRef<int>>& attrsData, size_t width, bool galloping)
+{
+    switch (relationIndices.size())
+    {
+    case 2: return MakeFixedKernel<2>(relationIndices, attrsData, width, galloping);
+    case 3: return MakeFixedKernel<3>(relationIndices, attrsData, width, galloping);
+    case 4: return MakeFixedKernel<4>(relationIndices, attrsData, width, galloping);
+    case 5: return MakeFixedKernel<5>(relationIndices, attrsData, width, galloping);
+    case 6: return MakeFixedKernel<6>(relationIndices, attrsData, width, galloping);
+    case 7: return MakeFixedKernel<7>(relationIndices, attrsData, width, galloping);
+    case 8: return MakeFixedKernel<8>(relationIndices, attrsData, width, galloping);
+    default: return {};
+    }
+}
@@ -0,0 +1,131 @@
+#include "LeapfrogJoin.h"
+
+#include <iostream>
+#include <stdexcept>
+
+
+void LeapfrogTrieJoin::TrieIterator::Next()
+{
+    positions[depth] = columns[depth].get().GallopUpperBound(positions[depth], ends[depth], Key());
+}
+
+void LeapfrogTrieJoin::TrieIterator::Seek(int value)
+{
+    positions[depth] = columns[depth].get().GallopLowerBound(positions[depth], ends[depth], value);
+}
+
+// Descends to the next column, restricted to the rows holding the current key
+void LeapfrogTrieJoin::TrieIterator::Open()
+{
+    size_t st = 0, ed = tupleNum;
+    if (depth >= 0)
+    {
+        st = positions[depth];
+        ed = columns[depth].get().GallopUpperBound(st, ends[depth], Key());
+    }
+
+    depth++;
+    positions[depth] = st;
+    ends[depth] = ed;
+}
+
+
+LeapfrogTrieJoin::LeapfrogTrieJoin(std::vector<Relation>&& relations, const std::vector<std::string>& gvo)
+    : mRelations(std::move(relations)), mGVO(gvo), mLevelIterators(gvo.size())
+{
+    for (size_t relId = 0; relId < mRelations.size(); relId++)
+    {
+        auto& rel = mRelations[relId];
+
+        TrieIterator iter;
+        iter.tupleNum = rel.Length();
+        for (size_t level = 0; level < mGVO.size(); level++)
+        {
+            if (!rel.ExistAttr(mGVO[level]))
+                continue;
+            iter.columns.emplace_back(rel[mGVO[level]]);
+            mLevelIterators[level].push_back(relId);
+        }
+
+        if (iter.columns.size() != rel.Attrs().size())
+            throw std::invalid_argument("GVO does not cover every attribute of " + rel.Name());
+
+        iter.ends.resize(iter.columns.size());
+        iter.positions.resize(iter.columns.size());
+        mIterators.emplace_back(std::move(iter));
+    }
+
+    for (size_t level = 0; level < mGVO.size(); level++)
+        if (mLevelIterators[level].empty())
+            throw std::invalid_argument("No relation contains attribute " + mGVO[level]);
+}
+
+
+// Leapfrog over the iterators of one level: the candidate only grows, each iterator seeks to it
+// in turn, and once all of them agree the next level is joined under that value.
+size_t LeapfrogTrieJoin::Join(size_t level)
+{
+    if (level == mGVO.size())
+        return 1;
+
+    auto& iterIds = mLevelIterators[level];
+    const size_t iterNum = iterIds.size();
+
+    bool empty = false;
+    for (size_t iterId : iterIds)
+    {
+        mIterators[iterId].Open();
+        empty = empty or mIterators[iterId].AtEnd();
+    }
+
+    size_t count = 0;
+    if (!empty)
+    {
+        int candidate = mIterators[iterIds[0]].Key();
+        size_t agreed = 0;
+        size_t i = 0;
+        while (true)
+        {
+            auto& iter = mIterators[iterIds[i]];
+            iter.Seek(candidate);
+            if (iter.AtEnd())
+                break;
+
+            if (iter.Key() != candidate)
+            {
+                candidate = iter.Key();
+                agreed = 1;
+                i = (i + 1) % iterNum;
+                continue;
+            }
+            if (++agreed < iterNum)
+            {
+                i = (i + 1) % iterNum;
+                continue;
+            }
+
+            count += Join(level + 1);
+
+            iter.Next();
+            if (iter.AtEnd())
+                break;
+            candidate = iter.Key();
+            agreed = 0;
+        }
+    }
+
+    for (size_t iterId : iterIds)
+        mIterators[iterId].Up();
+
+    return count;
+}
+
+
+Relation LeapfrogTrieJoin::operator()()
+{
+    size_t resultNum = mGVO.empty() ? 0 : Join(0);
+
+    std::cout << "Join results number: " << resultNum << std::endl;
+
+    return Relation();
+}
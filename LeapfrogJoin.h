@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Relation.h"
+
+#include <string>
+#include <vector>
+
+
+// Tuple-at-a-time Leapfrog Triejoin over relations sorted by the GVO. Unlike GenericJoin it
+// keeps no range tables: every relation is walked through a trie iterator and only the current
+// path is held in memory.
+class LeapfrogTrieJoin
+{
+public:
+    LeapfrogTrieJoin(std::vector<Relation>&& relations, const std::vector<std::string>& gvo);
+
+    Relation operator()();
+
+private:
+    // Trie view of a relation whose columns are sorted lexicographically in GVO order. Depth d
+    // walks the distinct values of the d-th column inside the range fixed by the upper levels.
+    struct TrieIterator
+    {
+        std::vector<AttributeRef<int>> columns;
+        std::vector<size_t> ends;
+        std::vector<size_t> positions;
+        size_t tupleNum;
+        int depth = -1;
+
+        int Key() const { return columns[depth].get()[positions[depth]]; }
+
+        bool AtEnd() const { return positions[depth] >= ends[depth]; }
+
+        void Next();
+
+        void Seek(int value);
+
+        void Open();
+
+        void Up() { depth--; }
+    };
+
+    size_t Join(size_t level);
+
+private:
+    std::vector<Relation> mRelations;
+    std::vector<std::string> mGVO;
+    std::vector<TrieIterator> mIterators;
+    std::vector<std::vector<size_t>> mLevelIterators; // iterators taking part in each GVO level
+};
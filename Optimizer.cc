@@ -23,6 +23,7 @@ constexpr bool Debug = false;
 std::unique_ptr<LTPlan> LTOptimizer::operator()()
 {
     GVO.clear();
+    EstimateCache::Shared().Bind(mRelations, mAttrs);
     // std::vector<size_t> relIndices(GloablData::GRelation.size());
     std::vector<size_t> relIndices(mRelations.size());
     std::iota(relIndices.begin(), relIndices.end(), 0);
@@ -293,8 +294,8 @@ TopDownLTOptimizer::GeneratePlanInternal(std::vector<size_t>& relationIndices, s
         double currentEstimatedSize = 0;
         if ( currentRelationGroups.size() == 1 )
         {
-            Estimator estimator(relations, currentRelationGroups[0].second);
-            currentEstimatedSize = estimator("GLOP");
+            Estimator estimator(relations, currentRelationGroups[0].second, mEstimateModel);
+            currentEstimatedSize = estimator();
         }
         // bool suppressAttrSplit = false;
         if ( currentRelationGroups.size() > 1 )
@@ -307,7 +308,7 @@ TopDownLTOptimizer::GeneratePlanInternal(std::vector<size_t>& relationIndices, s
             //     for (size_t i : subRelations)
             //         curRelRefs.emplace_back(mRelations[i]);
             //     Estimator estimator(curRelRefs, subAttrs);
-            //     unsplitCost *= estimator("GLOP");
+            //     unsplitCost *= estimator();
             // }
 
             // double splitCost = 0;
@@ -322,8 +323,8 @@ TopDownLTOptimizer::GeneratePlanInternal(std::vector<size_t>& relationIndices, s
                 std::vector<RelationRef> curRelRefs;
                 for (size_t i : subRelations)
                     curRelRefs.emplace_back(mRelations[i]);
-                Estimator estimator(curRelRefs, subAttrs);
-                double curEstiCost = estimator("GLOP"); 
+                Estimator estimator(curRelRefs, subAttrs, mEstimateModel);
+                double curEstiCost = estimator(); 
                 currentEstimatedSize += curEstiCost + curEstiCost * std::log2f(curEstiCost);
             }
             // if (unsplitCost < splitCost)
@@ -528,8 +529,8 @@ TopDownLTOptimizer::MakePlanIntern(std::vector<size_t>& relationIndices, std::ve
         double currentEstimatedSize = 0;
         if ( currentRelationGroups.size() == 1 )
         {
-            Estimator estimator(relations, currentRelationGroups[0].second);
-            currentEstimatedSize = estimator("GLOP");
+            Estimator estimator(relations, currentRelationGroups[0].second, mEstimateModel);
+            currentEstimatedSize = estimator();
         }
         else if ( currentRelationGroups.size() > 1 )
         {
@@ -539,8 +540,8 @@ TopDownLTOptimizer::MakePlanIntern(std::vector<size_t>& relationIndices, std::ve
                 std::vector<RelationRef> curRelRefs;
                 for (size_t i : subRelations)
                     curRelRefs.emplace_back(GloablData::GRelation[i]);
-                Estimator estimator(curRelRefs, subAttrs);
-                double workload = estimator("GLOP");
+                Estimator estimator(curRelRefs, subAttrs, mEstimateModel);
+                double workload = estimator();
                 currentEstimatedSize += workload + workload * std::log2f(workload);
             }
         }
@@ -732,8 +733,8 @@ DPLTOptimizer::MakePlanIntern(std::vector<size_t>& relationIndices, std::vector<
                         }
                 }
 
-                Estimator estimator(relations, estimatedAttrs);
-                double estimatedIncCost = estimator("GLOP") + k1plan.cost;
+                Estimator estimator(relations, estimatedAttrs, mEstimateModel);
+                double estimatedIncCost = estimator() + k1plan.cost;
 
                 size_t hashValue = std::hash<std::vector<std::string>>{}(estimatedAttrs);
 
@@ -909,8 +910,8 @@ void DPLTOptimizer::GeneratePlanOrder(std::vector<size_t>& relationIndices, std:
                         }
                 }
 
-                Estimator estimator(relations, estimatedAttrs);
-                double estimatedIncCost = estimator("GLOP") + k1plan.cost;
+                Estimator estimator(relations, estimatedAttrs, mEstimateModel);
+                double estimatedIncCost = estimator() + k1plan.cost;
 
                 size_t hashValue = std::hash<std::vector<std::string>>{}(estimatedAttrs);
 
@@ -1020,8 +1021,8 @@ void DP5LTOptimizer::GeneratePlanOrder(std::vector<size_t>& relationIndices, std
                         }
                 }
 
-                Estimator estimator(relations, estimatedAttrs);
-                double estimatedIncCost = estimator("GLOP") + k1plan.cost;
+                Estimator estimator(relations, estimatedAttrs, mEstimateModel);
+                double estimatedIncCost = estimator() + k1plan.cost;
 
                 size_t hashValue = std::hash<std::vector<std::string>>{}(estimatedAttrs);
 
@@ -1125,8 +1126,8 @@ EHLTOptimizer::GeneratePlanInternal(std::vector<size_t>& relationIndices, std::v
             std::vector<RelationRef> relRefs;
             for (size_t rid : relIndices)
                 relRefs.emplace_back(mRelations[rid]);
-            Estimator estimator(relRefs, atts);
-            currentEstimatedCost += estimator("GLOP");
+            Estimator estimator(relRefs, atts, mEstimateModel);
+            currentEstimatedCost += estimator();
         }
 
         if (estimiatedCost > currentEstimatedCost)
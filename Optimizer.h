@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Estimator.h"
 #include "Plan.h"
 #include "Relation.h"
 
@@ -24,6 +25,8 @@ public:
 
     std::unique_ptr<LTPlan> operator()();
 
+    void SetEstimateModel(EstimateModel model) { mEstimateModel = model; }
+
 protected:
     virtual std::unique_ptr<LTPlan> 
     GeneratePlan(std::vector<size_t>& relationIndices, std::vector<std::string>& attrs);
@@ -41,6 +44,7 @@ protected:
 
     std::vector<RelationRef> mRelations;
     std::vector<std::string> mAttrs;
+    EstimateModel mEstimateModel = EstimateModel::Agm;
 
 public:
     std::vector<std::string> GVO;
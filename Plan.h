@@ -22,6 +22,9 @@ public:
 
     virtual std::unique_ptr<LTPlan> NextSubPlan() { return nullptr; }
 
+    // The sub-plans without taking them, for passes over the plan before it is executed
+    virtual std::vector<LTPlan*> SubPlans() { return {}; }
+
     virtual bool IsEH() { return false; }
 
     void AddRelationIndex(size_t index) { mRelatedRelationIndices.push_back(index); }
@@ -67,6 +70,14 @@ public:
         return nextPlan;
     }
 
+    virtual std::vector<LTPlan*> SubPlans() override
+    {
+        std::vector<LTPlan*> plans;
+        for (auto& plan : mNextPlan)
+            plans.push_back(plan.get());
+        return plans;
+    }
+
     virtual std::string GetAttr() override { return mAttr; }
 
 private:
@@ -100,6 +111,14 @@ public:
         return nextPlan;
     }
 
+    virtual std::vector<LTPlan*> SubPlans() override
+    {
+        std::vector<LTPlan*> plans;
+        for (auto& plan : mNextPlan)
+            plans.push_back(plan.get());
+        return plans;
+    }
+
     virtual std::string GetAttr() override { return mAttr; }
 
 private:
@@ -131,6 +150,14 @@ public:
     }
 
 
+    virtual std::vector<LTPlan*> SubPlans() override
+    {
+        std::vector<LTPlan*> plans;
+        for (auto& [plan, attrs] : mNextPlan)
+            plans.push_back(plan.get());
+        return plans;
+    }
+
     virtual bool IsEH() override { return true; }
 
 public:
@@ -169,6 +196,13 @@ public:
         return plan;
     }
 
+    virtual std::vector<LTPlan*> SubPlans() override
+    {
+        if (mNextPlan == nullptr)
+            return {};
+        return {mNextPlan.get()};
+    }
+
     virtual std::string GetAttr() override { return mAttr; }
 
 private:
@@ -32,13 +32,13 @@ class RangeTable
 {
 public:
     RangeTable(size_t relationNum, size_t maxTupleNum)
-        : mRelationNum(relationNum), mTupleNum(0), mRanges(nullptr)
+        : mRelationNum(relationNum), mTupleNum(0), mCapacity(maxTupleNum), mRanges(nullptr)
     {
         mRanges = new Range[mRelationNum * maxTupleNum];
     }
 
     RangeTable(RangeTable&& table)
-        : mRelationNum(table.mRelationNum), mTupleNum(table.mTupleNum), mRanges(table.mRanges), mRelationIndices(std::move(table.mRelationIndices))
+        : mRelationNum(table.mRelationNum), mTupleNum(table.mTupleNum), mCapacity(table.mCapacity), mRanges(table.mRanges), mRelationIndices(std::move(table.mRelationIndices))
     {
         table.mRanges = nullptr;
     }
@@ -49,9 +49,12 @@ public:
         mRanges = nullptr;
     }
 
-    // Get the last unused tuple and increase one to mTupleNum
+    // Get the last unused tuple and increase one to mTupleNum, growing the table when it is full
     RangeTuple AcquireTuple()
     {
+        if (mTupleNum == mCapacity)
+            Reserve(std::max<size_t>(mCapacity * 2, 16));
+
         RangeTuple tuple = &mRanges[mTupleNum * mRelationNum];
         mTupleNum++;
 
@@ -60,15 +63,58 @@ public:
 
     RangeTable& operator=(RangeTable&& table)
     {
+        if (this == &table)
+            return *this;
+
+        delete[] mRanges;
         mRelationNum = table.mRelationNum;
         mTupleNum = table.mTupleNum;
+        mCapacity = table.mCapacity;
         mRanges = table.mRanges;
+        mRelationIndices = std::move(table.mRelationIndices);
 
         table.mRanges = nullptr;
 
         return *this;
     }
 
+    void Reserve(size_t tupleNum)
+    {
+        if (tupleNum <= mCapacity)
+            return;
+
+        Range* ranges = new Range[mRelationNum * tupleNum];
+        std::copy(mRanges, mRanges + mRelationNum * mTupleNum, ranges);
+        delete[] mRanges;
+        mRanges = ranges;
+        mCapacity = tupleNum;
+    }
+
+    // Drop all tuples but keep the storage
+    void Clear() { mTupleNum = 0; }
+
+    // Release the storage beyond the tuples held
+    void ShrinkToFit()
+    {
+        if (mCapacity == mTupleNum)
+            return;
+
+        Range* ranges = new Range[mRelationNum * mTupleNum];
+        std::copy(mRanges, mRanges + mRelationNum * mTupleNum, ranges);
+        delete[] mRanges;
+        mRanges = ranges;
+        mCapacity = mTupleNum;
+    }
+
+    // Copy the tuples of a table with the same width to the end of this one
+    void Append(const RangeTable& table)
+    {
+        assert(table.mRelationNum == mRelationNum);
+        Reserve(mTupleNum + table.mTupleNum);
+        std::copy(table.mRanges, table.mRanges + mRelationNum * table.mTupleNum, mRanges + mRelationNum * mTupleNum);
+        mTupleNum += table.mTupleNum;
+    }
+
     RangeTuple operator[](size_t index)
     {
         return &(mRanges[index * mRelationNum]);
@@ -76,6 +122,8 @@ public:
 
     size_t Length() const { return mTupleNum; }
 
+    size_t Capacity() const { return mCapacity; }
+
     size_t Width() const { return mRelationNum; }
 
     void Print()
@@ -159,6 +207,7 @@ public:
 private:
     size_t mRelationNum;
     size_t mTupleNum;
+    size_t mCapacity;
 
     Range* mRanges;
 
@@ -51,5 +51,18 @@ void Relation::Sort(std::vector<std::string>& attrOrder)
 }
 
 
+void Relation::Filter(const std::vector<bool>& keep)
+{
+    const size_t keptNum = std::count(keep.begin(), keep.end(), true);
+    for (auto& [name, attr] : mAttributes)
+    {
+        std::vector<int> data;
+        data.reserve(keptNum);
+        for (size_t i = 0; i < Length(); i++)
+            if (keep[i])
+                data.push_back(attr[i]);
 
-
+        attr = std::move(data);
+    }
+    mTupleNum = keptNum;
+}
@@ -1,15 +1,76 @@
 #pragma once
 
+#include "Bitmap.h"
+#include "SearchIndex.h"
+
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <numeric>
 #include <string>
 #include <utility>
 #include <vector>
 
 
+// Exponential search starting at fromIndex, for cursors that only move forward.
+// Returns the first index in [fromIndex, endIndex) whose value is not less than value.
+template<typename T>
+size_t GallopLowerBound(const T* data, size_t fromIndex, size_t endIndex, T value)
+{
+    size_t lo = fromIndex, hi = fromIndex, step = 1;
+    while (hi < endIndex and data[hi] < value)
+    {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    hi = std::min(hi, endIndex);
+
+    return std::lower_bound(data + lo, data + hi, value) - data;
+}
+
+// Same as GallopLowerBound, but returns the first index whose value is greater than value.
+template<typename T>
+size_t GallopUpperBound(const T* data, size_t fromIndex, size_t endIndex, T value)
+{
+    size_t lo = fromIndex, hi = fromIndex, step = 1;
+    while (hi < endIndex and data[hi] <= value)
+    {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    hi = std::min(hi, endIndex);
+
+    return std::upper_bound(data + lo, data + hi, value) - data;
+}
+
+template<typename T>
+size_t GallopLowerBound(const std::vector<T>& data, size_t fromIndex, size_t endIndex, T value)
+{
+    return GallopLowerBound(data.data(), fromIndex, endIndex, value);
+}
+
+template<typename T>
+size_t GallopUpperBound(const std::vector<T>& data, size_t fromIndex, size_t endIndex, T value)
+{
+    return GallopUpperBound(data.data(), fromIndex, endIndex, value);
+}
+
+
+// Distinct values of a column and the most rows sharing one value
+struct DegreeStats
+{
+    size_t distinct = 0;
+    size_t maxDegree = 0;
+};
+
+
 template<typename T>
 class Attribute
 {
@@ -19,22 +80,184 @@ public:
     {
     }
 
+    // Moves the data and the caches; the locks are not moved, so no other thread may use either attribute
+    Attribute(Attribute<T>&& attribute)
+        : mData(std::move(attribute.mData)), mKeys(std::move(attribute.mKeys)), mRunStart(std::move(attribute.mRunStart)),
+          mRunOf(std::move(attribute.mRunOf)), mDistinctIndexBuilt(attribute.mDistinctIndexBuilt.load()),
+          mBitmaps(std::move(attribute.mBitmaps)), mBitmapBytes(attribute.mBitmapBytes), mBitmapHand(attribute.mBitmapHand),
+          mSearchIndex(std::move(attribute.mSearchIndex)), mSearchIndexMinLength(attribute.mSearchIndexMinLength),
+          mDegrees(attribute.mDegrees), mDegreesCounted(attribute.mDegreesCounted.load())
+    {
+    }
+
     Attribute<T>& operator=(std::vector<T>&& data)
     {
         std::swap(mData, data);
+        mKeys.clear();
+        mRunStart.clear();
+        mRunOf.clear();
+        mDistinctIndexBuilt = false;
+        mBitmaps.clear();
+        mBitmapBytes = 0;
+        mBitmapHand = {0, 0};
+        mSearchIndex.Clear();
+        mDegrees = DegreeStats{};
+        mDegreesCounted = false;
 
         return *this;
     }
 
     auto Query(size_t startIndex, size_t endIndex, T value) const
     {
-        auto start = mData.begin() + startIndex;
-        auto end   = mData.begin() + endIndex;
+        size_t lower = LowerBound(startIndex, endIndex, value);
+        size_t upper = UpperBound(startIndex, endIndex, value);
+
+        return std::make_pair(mData.begin() + lower, mData.begin() + upper);
+    }
+
+    // Binary search of the sorted range [startIndex, endIndex), through the search index for
+    // ranges of at least the length it was built for
+    size_t LowerBound(size_t startIndex, size_t endIndex, T value) const
+    {
+        if (endIndex - startIndex >= mSearchIndexMinLength and !mSearchIndex.Empty())
+            return mSearchIndex.Bound(mData.data(), startIndex, endIndex, value, false);
+        return std::lower_bound(mData.begin() + startIndex, mData.begin() + endIndex, value) - mData.begin();
+    }
 
-        auto lowerIter  = std::lower_bound(start, end, value);
-        auto upperIter = std::upper_bound(start, end, value);
+    size_t UpperBound(size_t startIndex, size_t endIndex, T value) const
+    {
+        if (endIndex - startIndex >= mSearchIndexMinLength and !mSearchIndex.Empty())
+            return mSearchIndex.Bound(mData.data(), startIndex, endIndex, value, true);
+        return std::upper_bound(mData.begin() + startIndex, mData.begin() + endIndex, value) - mData.begin();
+    }
+
+    // Auxiliary k-ary search index used by LowerBound, UpperBound and Query for ranges of at
+    // least minLength rows. Built once; later calls keep the first minLength.
+    void BuildSearchIndex(size_t minLength)
+    {
+        std::lock_guard<std::mutex> lock(mBuildMutex);
+        if (!mSearchIndex.Empty())
+            return;
 
-        return std::make_pair(lowerIter, upperIter);
+        mSearchIndex.Build(mData.data(), mData.size());
+        mSearchIndexMinLength = std::max<size_t>(minLength, 1);
+    }
+
+    // Exponential search starting at fromIndex, for cursors that only move forward.
+    size_t GallopLowerBound(size_t fromIndex, size_t endIndex, T value) const
+    {
+        return ::GallopLowerBound(mData, fromIndex, endIndex, value);
+    }
+
+    size_t GallopUpperBound(size_t fromIndex, size_t endIndex, T value) const
+    {
+        return ::GallopUpperBound(mData, fromIndex, endIndex, value);
+    }
+
+    // Run-length index: one key per run of equal adjacent values. Within a range whose values
+    // are sorted, the runs from RunOf(st) to RunOf(ed-1) hold its distinct values in order.
+    void BuildDistinctIndex()
+    {
+        if (HasDistinctIndex())
+            return;
+        std::lock_guard<std::mutex> lock(mBuildMutex);
+        if (HasDistinctIndex())
+            return;
+
+        mRunOf.resize(mData.size());
+        for (size_t index = 0; index < mData.size(); index++)
+        {
+            if (index == 0 or mData[index] != mData[index-1])
+            {
+                mKeys.push_back(mData[index]);
+                mRunStart.push_back(index);
+            }
+            mRunOf[index] = mKeys.size() - 1;
+        }
+        mRunStart.push_back(mData.size());
+        mDistinctIndexBuilt.store(true, std::memory_order_release);
+    }
+
+    bool HasDistinctIndex() const { return mDistinctIndexBuilt.load(std::memory_order_acquire); }
+
+    const std::vector<T>& DistinctKeys() const { return mKeys; }
+
+    size_t RunOf(size_t index) const { return mRunOf[index]; }
+
+    size_t RunStart(size_t run) const { return mRunStart[run]; }
+
+    // Runs [first, second) holding the distinct keys of the sorted range [st, ed), st < ed
+    std::pair<size_t, size_t> KeySlice(size_t st, size_t ed) const
+    {
+        return {mRunOf[st], mRunOf[ed-1] + 1};
+    }
+
+    // Bitmap of the distinct keys of the sorted range [st, ed), built on first use. Meant for
+    // ranges with many distinct keys, e.g. the neighbours of a high degree vertex. Bitmaps are
+    // cached by the runs they cover, so ranges over the same keys, such as the pieces of a split
+    // heavy range, share one. The cache holds at most MaxDenseBitmapBytes per column and evicts
+    // with the CLOCK policy; an evicted bitmap lives on while a caller still holds it.
+    std::shared_ptr<const RoaringBitmap> DenseBitmap(size_t st, size_t ed)
+    {
+        auto runs = KeySlice(st, ed);
+        {
+            std::shared_lock<std::shared_mutex> lock(mBitmapMutex);
+            auto iter = mBitmaps.find(runs);
+            if (iter != mBitmaps.end())
+            {
+                iter->second.referenced.store(true, std::memory_order_relaxed);
+                return iter->second.bitmap;
+            }
+        }
+
+        // built outside the lock; a bitmap another thread inserted meanwhile wins
+        auto bitmap = std::make_shared<const RoaringBitmap>(mKeys.data() + runs.first, runs.second - runs.first);
+        const size_t bytes = bitmap->Bytes();
+
+        std::unique_lock<std::shared_mutex> lock(mBitmapMutex);
+        auto iter = mBitmaps.find(runs);
+        if (iter != mBitmaps.end())
+            return iter->second.bitmap;
+
+        while (!mBitmaps.empty() and mBitmapBytes + bytes > MaxDenseBitmapBytes)
+        {
+            auto hand = mBitmaps.lower_bound(mBitmapHand);
+            hand = hand == mBitmaps.end() ? mBitmaps.begin() : hand;
+            if (hand->second.referenced.exchange(false, std::memory_order_relaxed))
+                hand++;
+            else
+            {
+                mBitmapBytes -= hand->second.bytes;
+                hand = mBitmaps.erase(hand);
+            }
+            mBitmapHand = hand == mBitmaps.end() ? std::make_pair<size_t, size_t>(0, 0) : hand->first;
+        }
+
+        mBitmapBytes += bytes;
+        mBitmaps.try_emplace(runs, bitmap, bytes);
+        return bitmap;
+    }
+
+    // Counted on first use over a sorted copy, as the optimizers ask before the data is sorted
+    DegreeStats Degrees()
+    {
+        if (mDegreesCounted.load(std::memory_order_acquire))
+            return mDegrees;
+        std::lock_guard<std::mutex> lock(mBuildMutex);
+        if (!mDegreesCounted.load(std::memory_order_relaxed))
+        {
+            std::vector<T> sorted(mData);
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t st = 0, ed = 0; st < sorted.size(); st = ed)
+            {
+                ed = std::upper_bound(sorted.begin() + st, sorted.end(), sorted[st]) - sorted.begin();
+                mDegrees.distinct++;
+                mDegrees.maxDegree = std::max(mDegrees.maxDegree, ed - st);
+            }
+            mDegreesCounted.store(true, std::memory_order_release);
+        }
+
+        return mDegrees;
     }
 
     auto Begin() const
@@ -48,6 +271,40 @@ public:
 
 private:
     std::vector<T> mData;
+
+    std::vector<T> mKeys;
+    std::vector<size_t> mRunStart;
+    std::vector<uint32_t> mRunOf;
+    std::atomic<bool> mDistinctIndexBuilt = false;
+
+    struct DenseBitmapEntry
+    {
+        DenseBitmapEntry(std::shared_ptr<const RoaringBitmap> bitmap, size_t bytes)
+            : bitmap(std::move(bitmap)), bytes(bytes), referenced(false)
+        {}
+
+        std::shared_ptr<const RoaringBitmap> bitmap;
+        size_t bytes;
+        std::atomic<bool> referenced;
+    };
+
+    static constexpr size_t MaxDenseBitmapBytes = size_t(64) << 20;
+
+    std::map<std::pair<size_t, size_t>, DenseBitmapEntry> mBitmaps;    // by runs
+    size_t mBitmapBytes = 0;
+    std::pair<size_t, size_t> mBitmapHand{0, 0};
+
+    KarySearchIndex<T> mSearchIndex;
+    size_t mSearchIndexMinLength = 0;
+
+    DegreeStats mDegrees;
+    std::atomic<bool> mDegreesCounted = false;
+
+    // The indexes and statistics are built once under mBuildMutex and published through their
+    // flags, so readers take no lock. Bitmap lookups share mBitmapMutex, which only inserting
+    // and evicting take exclusively. Both are per column, as concurrent operators read many.
+    std::mutex mBuildMutex;
+    std::shared_mutex mBitmapMutex;
 };
 
 template<typename T>
@@ -98,7 +355,8 @@ public:
         return mName;
     }
 
-    void Filter();
+    // Keep the tuples whose flag is set, in their order
+    void Filter(const std::vector<bool>& keep);
 
     void Sort(std::vector<std::string>& attrOrder);
 
@@ -0,0 +1,200 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+
+namespace
+{
+
+// walks between two looks at the clock
+constexpr size_t ClockInterval = 16;
+
+constexpr uint64_t Seed = 0x5eed;
+
+} // namespace
+
+
+JoinSampler& JoinSampler::Shared()
+{
+    static JoinSampler sampler;
+    return sampler;
+}
+
+
+JoinSampler::JoinSampler()
+    : mWalkBudget(1024), mMillisBudget(0), mRandom(Seed), mEstimateNum(0), mWalkNum(0), mSurvivedWalkNum(0),
+      mErrorEstimateNum(0), mRelativeErrorSum(0), mMaxRelativeError(0)
+{
+}
+
+
+void JoinSampler::SetBudget(size_t walks, double millis)
+{
+    mWalkBudget = walks;
+    mMillisBudget = millis;
+}
+
+
+const std::vector<Attribute<int>>& JoinSampler::SortedProjection(Relation& relation, const std::vector<std::string>& attrs)
+{
+    auto key = std::make_pair(static_cast<const Relation*>(&relation), attrs);
+    auto iter = mProjections.find(key);
+    if (iter != mProjections.end())
+        return iter->second;
+
+    std::vector<AttributeRef<int>> columns;
+    for (const auto& attr : attrs)
+        columns.emplace_back(relation[attr]);
+
+    std::vector<size_t> rows(relation.Length());
+    std::iota(rows.begin(), rows.end(), 0);
+    std::sort(rows.begin(), rows.end(), [&](size_t row1, size_t row2) {
+        for (const auto& column : columns)
+            if (column.get()[row1] != column.get()[row2])
+                return column.get()[row1] < column.get()[row2];
+        return false;
+    });
+
+    std::vector<Attribute<int>> projection;
+    projection.reserve(columns.size());
+    for (const auto& column : columns)
+    {
+        std::vector<int> data(rows.size());
+        for (size_t i = 0; i < rows.size(); i++)
+            data[i] = column.get()[rows[i]];
+        projection.emplace_back(std::move(data));
+    }
+
+    return mProjections.emplace(std::move(key), std::move(projection)).first->second;
+}
+
+
+double JoinSampler::Estimate(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, double& relativeError)
+{
+    // walk order: start at the attribute of the smallest relation, then keep to attributes
+    // sharing a relation with the bound ones, again by the smallest relation
+    std::vector<size_t> order;
+    std::vector<bool> bound(attrs.size(), false);
+    std::vector<bool> touched(relations.size(), false);
+    while (true)
+    {
+        size_t next = attrs.size();
+        std::pair<bool, size_t> best;
+        for (size_t relIndex = 0; relIndex < relations.size(); relIndex++)
+            for (size_t attrIndex = 0; attrIndex < attrs.size(); attrIndex++)
+            {
+                if (bound[attrIndex] or !relations[relIndex].get().ExistAttr(attrs[attrIndex]))
+                    continue;
+                std::pair<bool, size_t> rank{!touched[relIndex], relations[relIndex].get().Length()};
+                if (next == attrs.size() or rank < best)
+                {
+                    best = rank;
+                    next = attrIndex;
+                }
+            }
+        if (next == attrs.size())
+            break;
+
+        bound[next] = true;
+        order.push_back(next);
+        for (size_t relIndex = 0; relIndex < relations.size(); relIndex++)
+            touched[relIndex] = touched[relIndex] or relations[relIndex].get().ExistAttr(attrs[next]);
+    }
+
+    // every relation takes part with its estimated attributes in walk order; steps[pos] lists
+    // the (relation, column) pairs binding the attribute at pos
+    std::vector<const std::vector<Attribute<int>>*> projections;
+    std::vector<size_t> lengths;
+    std::vector<std::vector<std::pair<size_t, size_t>>> steps(order.size());
+    for (size_t relIndex = 0; relIndex < relations.size(); relIndex++)
+    {
+        std::vector<std::string> relAttrs;
+        for (size_t pos = 0; pos < order.size(); pos++)
+            if (relations[relIndex].get().ExistAttr(attrs[order[pos]]))
+            {
+                steps[pos].emplace_back(projections.size(), relAttrs.size());
+                relAttrs.push_back(attrs[order[pos]]);
+            }
+        if (relAttrs.empty())
+            continue;
+        projections.push_back(&SortedProjection(relations[relIndex].get(), relAttrs));
+        lengths.push_back(relations[relIndex].get().Length());
+    }
+
+    mEstimateNum++;
+    relativeError = 0;
+    if (order.empty())
+        return 1;
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::pair<size_t, size_t>> ranges(projections.size());
+    size_t walks = 0, survived = 0;
+    double sum = 0, squareSum = 0;
+    while (mWalkBudget == 0 or walks < mWalkBudget)
+    {
+        if (mMillisBudget > 0 and walks % ClockInterval == 0 and walks > 0)
+        {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= mMillisBudget)
+                break;
+        }
+        walks++;
+
+        for (size_t slot = 0; slot < ranges.size(); slot++)
+            ranges[slot] = {0, lengths[slot]};
+
+        double weight = 1;
+        for (size_t pos = 0; pos < order.size() and weight > 0; pos++)
+        {
+            auto sampler = *std::min_element(steps[pos].begin(), steps[pos].end(), [&](const auto& step1, const auto& step2) {
+                return ranges[step1.first].second - ranges[step1.first].first < ranges[step2.first].second - ranges[step2.first].first;
+            });
+            auto [st, ed] = ranges[sampler.first];
+            if (st == ed)
+            {
+                weight = 0;
+                break;
+            }
+
+            const Attribute<int>& column = (*projections[sampler.first])[sampler.second];
+            int value = column[st + std::uniform_int_distribution<size_t>(0, ed - st - 1)(mRandom)];
+            for (auto [slot, col] : steps[pos])
+            {
+                const Attribute<int>& attribute = (*projections[slot])[col];
+                size_t lower = attribute.LowerBound(ranges[slot].first, ranges[slot].second, value);
+                size_t upper = attribute.UpperBound(lower, ranges[slot].second, value);
+                if (slot == sampler.first)
+                    weight *= double(ed - st) / (upper - lower);
+                else if (lower == upper)
+                    weight = 0;
+                ranges[slot] = {lower, upper};
+            }
+        }
+
+        survived += weight > 0;
+        sum += weight;
+        squareSum += weight * weight;
+    }
+
+    mWalkNum += walks;
+    mSurvivedWalkNum += survived;
+
+    const double mean = sum / walks;
+    if (survived == 0)
+    {
+        relativeError = std::numeric_limits<double>::infinity();
+        return 0;
+    }
+
+    const double variance = walks > 1 ? std::max(squareSum - walks * mean * mean, 0.0) / (walks - 1) : 0;
+    relativeError = std::sqrt(variance / walks) / mean;
+    mErrorEstimateNum++;
+    mRelativeErrorSum += relativeError;
+    mMaxRelativeError = std::max(mMaxRelativeError, relativeError);
+
+    return std::max(mean, 1.0);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Relation.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Wander join estimates of join sizes. A walk binds the attributes one at a time in an order
+// that follows the shared attributes. For each attribute, the relation holding it with the
+// fewest rows left picks one of those rows at random. Every other relation holding the attribute
+// must contain the picked value, otherwise the walk ends with 0. A surviving walk returns the
+// product over the attributes of rows / rows with the value, the inverse of the probability of
+// its path, so the mean over walks is an unbiased estimate of the number of results. The
+// relations are read through copies projected on the estimated attributes and sorted by the
+// walk order, so the rows left after binding a prefix are one range, narrowed by
+// Attribute::LowerBound and UpperBound. The copies are kept for later estimates.
+class JoinSampler
+{
+public:
+    static JoinSampler& Shared();
+
+    // Walks per estimate, 0 for no limit, and milliseconds per estimate, 0 for no limit; the
+    // estimate stops at whichever comes first
+    void SetBudget(size_t walks, double millis);
+
+    // Mean of the walks, at least 1 so the optimizers' cost formulas stay finite. If no walk
+    // survived, which does not make the join empty, returns 0 for no estimate and stores an
+    // infinite relativeError; otherwise relativeError is the relative standard error of the mean.
+    double Estimate(const std::vector<RelationRef>& relations, const std::vector<std::string>& attrs, double& relativeError);
+
+    // Frees the sorted copies once the optimizers are done
+    void ReleaseProjections() { mProjections.clear(); }
+
+    size_t EstimateNum() const { return mEstimateNum; }
+
+    size_t WalkNum() const { return mWalkNum; }
+
+    size_t SurvivedWalkNum() const { return mSurvivedWalkNum; }
+
+    // relative standard errors averaged over the estimates with a surviving walk
+    double MeanRelativeError() const { return mErrorEstimateNum ? mRelativeErrorSum / mErrorEstimateNum : 0; }
+
+    double MaxRelativeError() const { return mMaxRelativeError; }
+
+private:
+    JoinSampler();
+
+    // Columns of the relation's attrs, rows sorted by them in order
+    const std::vector<Attribute<int>>& SortedProjection(Relation& relation, const std::vector<std::string>& attrs);
+
+private:
+    size_t mWalkBudget;
+    double mMillisBudget;
+    std::mt19937_64 mRandom;
+
+    std::map<std::pair<const Relation*, std::vector<std::string>>, std::vector<Attribute<int>>> mProjections;
+
+    size_t mEstimateNum;
+    size_t mWalkNum;
+    size_t mSurvivedWalkNum;
+    size_t mErrorEstimateNum;
+    double mRelativeErrorSum;
+    double mMaxRelativeError;
+};
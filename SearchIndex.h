@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+
+// Static 16-ary search index over a column whose values are sorted within the ranges it is
+// queried on. Level l holds the values at positions that are multiples of 16^l, so the samples
+// inside any sorted range are sorted as well. A search starts at the level where the range holds
+// at most 16 or so samples and every level narrows it to the gap between two samples of that
+// level, i.e. to at most 16 samples of the level below, contiguous in memory: one cache line
+// per level instead of one miss per halving.
+template<typename T>
+class KarySearchIndex
+{
+public:
+    static constexpr size_t FanoutBits = 4;
+    static constexpr size_t Fanout = size_t(1) << FanoutBits;  // 16 ints make a cache line
+
+    void Build(const T* data, size_t length)
+    {
+        mLevels.clear();
+        const T* level = data;
+        size_t levelLength = length;
+        while (levelLength > Fanout)
+        {
+            std::vector<T> samples((levelLength + Fanout - 1) / Fanout);
+            for (size_t j = 0; j < samples.size(); j++)
+                samples[j] = level[j * Fanout];
+
+            mLevels.emplace_back(std::move(samples));
+            level = mLevels.back().data();
+            levelLength = mLevels.back().size();
+        }
+    }
+
+    bool Empty() const { return mLevels.empty(); }
+
+    void Clear() { mLevels.clear(); }
+
+    // First index in the sorted range [st, ed) of data whose value is not less than value, or
+    // greater than value when upper is set
+    size_t Bound(const T* data, size_t st, size_t ed, T value, bool upper) const
+    {
+        size_t lo = st, hi = ed;
+        size_t level = std::min(mLevels.size(), (std::bit_width(std::max<size_t>(ed - st, 1)) - 1) / FanoutBits);
+        for (; level > 0; level--)
+        {
+            const size_t shift = FanoutBits * level;
+            const size_t step = size_t(1) << shift;
+            size_t first = (lo + step - 1) >> shift;
+            size_t last = (hi + step - 1) >> shift;
+            if (first >= last)
+                continue;
+
+            // the answer lies after the last sample before value and at or before the next one
+            size_t before = CountBefore(mLevels[level - 1].data() + first, last - first, value, upper);
+            if (before > 0)
+                lo = std::max(lo, ((first + before - 1) << shift) + 1);
+            if (first + before < last)
+                hi = (first + before) << shift;
+        }
+
+        return lo + CountBefore(data + lo, hi - lo, value, upper);
+    }
+
+private:
+    static size_t CountBefore(const T* values, size_t n, T value, bool upper)
+    {
+        size_t count = 0;
+        if (upper)
+            for (size_t i = 0; i < n; i++)
+                count += values[i] <= value;
+        else
+            for (size_t i = 0; i < n; i++)
+                count += values[i] < value;
+        return count;
+    }
+
+private:
+    std::vector<std::vector<T>> mLevels;
+};
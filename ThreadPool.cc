@@ -0,0 +1,206 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+
+namespace
+{
+
+thread_local const ThreadPool* CurrentPool = nullptr;
+thread_local size_t CurrentWorkerId = 0;
+
+} // namespace
+
+
+ThreadPool::ThreadPool(size_t threadNum)
+    : mQueuedNum(0), mStop(false)
+{
+    threadNum = std::max<size_t>(threadNum, 1);
+    for (size_t i = 0; i < threadNum; i++)
+        mQueues.emplace_back(std::make_unique<WorkQueue>());
+
+    for (size_t workerId = 1; workerId < threadNum; workerId++)
+        mThreads.emplace_back(&ThreadPool::WorkerLoop, this, workerId);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mStop = true;
+    }
+    mSleepCond.notify_all();
+
+    for (auto& thread : mThreads)
+        thread.join();
+}
+
+
+size_t ThreadPool::WorkerId() const
+{
+    return CurrentPool == this ? CurrentWorkerId : 0;
+}
+
+
+void ThreadPool::Push(std::function<void()> task)
+{
+    auto& queue = *mQueues[WorkerId()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        mQueuedNum++;
+    }
+
+    // lock so that a worker checking mQueuedNum before sleeping cannot miss the notification
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+    }
+    mSleepCond.notify_one();
+}
+
+
+bool ThreadPool::TryRunOne(size_t workerId)
+{
+    std::function<void()> task;
+
+    // own tasks newest first, then steal the oldest task of the others
+    for (size_t i = 0; i < mQueues.size() and !task; i++)
+    {
+        auto& queue = *mQueues[(workerId + i) % mQueues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+
+        if (i == 0)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        mQueuedNum--;
+    }
+
+    if (!task)
+        return false;
+
+    task();
+    return true;
+}
+
+
+void ThreadPool::WorkerLoop(size_t workerId)
+{
+    CurrentPool = this;
+    CurrentWorkerId = workerId;
+
+    while (true)
+    {
+        if (TryRunOne(workerId))
+            continue;
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleepCond.wait(lock, [&]{ return mStop or mQueuedNum > 0; });
+        if (mStop)
+            return;
+    }
+}
+
+
+ThreadPool::TaskGroup::~TaskGroup()
+{
+    try
+    {
+        Wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+
+void ThreadPool::TaskGroup::Run(std::function<void()> task)
+{
+    mUnfinished++;
+    mPool.Push([this, task = std::move(task)]{
+        // the task counts as finished however it ends, so Wait() cannot spin forever
+        struct Finish
+        {
+            std::atomic<size_t>& unfinished;
+            ~Finish() { unfinished--; }
+        } finish{mUnfinished};
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mErrorMutex);
+            if (!mError)
+                mError = std::current_exception();
+        }
+    });
+}
+
+
+void ThreadPool::TaskGroup::Wait()
+{
+    size_t workerId = mPool.WorkerId();
+    while (mUnfinished > 0)
+    {
+        if (!mPool.TryRunOne(workerId))
+            std::this_thread::yield();
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(mErrorMutex);
+        std::swap(error, mError);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+void ThreadPool::ParallelFor(size_t n, size_t morselSize, const std::function<void(size_t, size_t, size_t)>& func)
+{
+    morselSize = std::max<size_t>(morselSize, 1);
+    if (ThreadNum() == 1)
+    {
+        for (size_t st = 0; st < n; st += morselSize)
+            func(WorkerId(), st, std::min(st + morselSize, n));
+        return;
+    }
+
+    TaskGroup group(*this);
+    std::function<void(size_t, size_t)> split = [&](size_t st, size_t ed){
+        while (ed - st > morselSize)
+        {
+            size_t morselNum = (ed - st + morselSize - 1) / morselSize;
+            size_t mid = st + morselNum / 2 * morselSize;
+            group.Run([&split, mid, ed]{ split(mid, ed); });
+            ed = mid;
+        }
+        func(WorkerId(), st, ed);
+    };
+
+    // the spawned morsels use split, so they have to finish before an exception leaves this scope
+    std::exception_ptr error;
+    try
+    {
+        if (n > 0)
+            split(0, n);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    group.Wait();
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Work-stealing task pool. Every worker owns a deque: it pushes and pops its own tasks at the
+// back and steals from the front of the other deques when it runs dry. The thread that created
+// the pool is worker 0 and takes part whenever it waits, so ThreadNum() threads run in total.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadNum);
+
+    ~ThreadPool();
+
+    size_t ThreadNum() const { return mQueues.size(); }
+
+    // Id in [0, ThreadNum()) of the calling thread; threads outside the pool count as worker 0
+    size_t WorkerId() const;
+
+    // Tasks spawned together and waited for together. Waiting executes pending tasks of the
+    // pool instead of blocking, so nested parallel sections share the same workers.
+    class TaskGroup
+    {
+    public:
+        TaskGroup(ThreadPool& pool)
+            : mPool(pool), mUnfinished(0)
+        {}
+
+        // Waits without rethrowing, as the group may be unwinding from an exception already
+        ~TaskGroup();
+
+        void Run(std::function<void()> task);
+
+        // Rethrows the first exception thrown by a task of the group, once all of them are done
+        void Wait();
+
+    private:
+        ThreadPool& mPool;
+        std::atomic<size_t> mUnfinished;
+        std::mutex mErrorMutex;
+        std::exception_ptr mError;
+    };
+
+    // Runs func(workerId, st, ed) once per morsel [k * morselSize, (k+1) * morselSize) of [0, n).
+    // Ranges are split in halves, so idle workers steal the biggest pieces first.
+    void ParallelFor(size_t n, size_t morselSize, const std::function<void(size_t, size_t, size_t)>& func);
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void Push(std::function<void()> task);
+
+    bool TryRunOne(size_t workerId);
+
+    void WorkerLoop(size_t workerId);
+
+private:
+    std::vector<std::unique_ptr<WorkQueue>> mQueues;
+    std::vector<std::thread> mThreads;
+
+    std::atomic<size_t> mQueuedNum;
+    std::atomic<bool> mStop;
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCond;
+};
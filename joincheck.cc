@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "GenericJoin.h"
+#include "JoinKernels.h"
+#include "Plan.h"
+#include "Range.h"
+
+
+// Consistency checks of the join operators the bundled queries do not reach: hand-built plans
+// over generated relations run with different operator options, and every run must report the
+// result count of a reference run. Prints one line per check and exits with 1 if any failed.
+// Usage: ./joinCheck
+
+
+namespace
+{
+
+constexpr unsigned Seed = 42;
+
+// Relation of at most rowNum distinct tuples over attrs, the values of attrs[i] drawn from [0, domains[i])
+Relation MakeRelation(const std::string& name, const std::vector<std::string>& attrs, const std::vector<int>& domains, size_t rowNum, std::mt19937& rng)
+{
+    std::vector<std::vector<int>> rows(rowNum, std::vector<int>(attrs.size()));
+    for (auto& row : rows)
+        for (size_t i = 0; i < attrs.size(); i++)
+            row[i] = std::uniform_int_distribution<int>(0, domains[i] - 1)(rng);
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    Relation relation;
+    relation.SetName(name);
+    relation.SetTupleNum(rows.size());
+    for (size_t i = 0; i < attrs.size(); i++)
+    {
+        std::vector<int> column(rows.size());
+        for (size_t row = 0; row < rows.size(); row++)
+            column[row] = rows[row][i];
+        relation.Insert(attrs[i], std::move(column));
+    }
+    return relation;
+}
+
+// Single-attribute WCO joins binding attrs in order over the relations of relIds holding them
+std::unique_ptr<LTPlan> MakeWCOChain(const std::vector<Relation>& relations, const std::vector<size_t>& relIds, const std::vector<std::string>& attrs)
+{
+    std::unique_ptr<LTPlan> plan;
+    for (auto& attr : attrs)
+    {
+        auto next = std::make_unique<BinaryLTPlan>();
+        next->AddAttr(attr);
+        next->cost = 0;
+        for (size_t relId : relIds)
+            if (relations[relId].ExistAttr(attr))
+                next->AddRelationIndex(relId);
+        if (plan)
+            next->AddSubPlan(std::move(plan));
+        plan = std::move(next);
+    }
+    return plan;
+}
+
+// One query: generates its relations sorted by the GVO and builds the plan to check
+struct Query
+{
+    std::vector<std::string> gvo;
+    std::function<std::vector<Relation>()> relations;
+    std::function<std::unique_ptr<LTPlan>(const std::vector<Relation>&)> plan;
+};
+
+size_t RunJoin(const Query& query, JoinOptions options)
+{
+    std::vector<Relation> relations = query.relations();
+    std::vector<std::string> gvo = query.gvo;
+    for (auto& relation : relations)
+        relation.Sort(gvo);
+    auto plan = query.plan(relations);
+
+    options.gvo = gvo;
+    GenericJoin join(std::move(plan), std::move(relations), std::move(gvo), options);
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    join();
+    std::cout.rdbuf(out);
+    return join.ResultNum();
+}
+
+bool Check(const std::string& name, size_t expected, size_t result)
+{
+    std::cout << (expected == result ? "ok   " : "FAIL ") << name << ": " << result;
+    if (expected != result)
+        std::cout << " expected " << expected;
+    std::cout << std::endl;
+    return expected == result;
+}
+
+
+// Two pairs of relations share X and one attribute of their own each. The loop join plan joins
+// the WCO results of the pairs on X; the reference binds every attribute by WCO joins. The loop
+// join sizes its output by the product of the sub-table lengths, hence only two pairs.
+bool CheckLoopJoins()
+{
+    auto relations = []{
+        std::mt19937 rng(Seed);
+        std::vector<Relation> relations;
+        for (const std::string attr : {"A", "C"})
+        {
+            relations.push_back(MakeRelation("R" + attr, {"X", attr}, {256, 8}, 1500, rng));
+            relations.push_back(MakeRelation("S" + attr, {"X", attr}, {256, 8}, 1500, rng));
+        }
+        return relations;
+    };
+    Query reference{{"X", "A", "C"}, relations, [](const std::vector<Relation>& relations){
+        return MakeWCOChain(relations, {0, 1, 2, 3}, {"X", "A", "C"});
+    }};
+    Query loop{{"X", "A", "C"}, relations, [](const std::vector<Relation>& relations){
+        std::unique_ptr<LTPlan> plan = std::make_unique<BinaryLTPlan>();
+        plan->AddAttr("X");
+        plan->cost = 0;
+        for (size_t relId = 0; relId < relations.size(); relId++)
+            plan->AddRelationIndex(relId);
+        plan->AddSubPlan(MakeWCOChain(relations, {0, 1}, {"X", "A"}));
+        plan->AddSubPlan(MakeWCOChain(relations, {2, 3}, {"X", "C"}));
+        return plan;
+    }};
+
+    const size_t expected = RunJoin(reference, JoinOptions{});
+    bool passed = expected > 0;
+    if (!passed)
+        std::cout << "FAIL loop join reference: no results to compare" << std::endl;
+
+    JoinOptions search;
+    passed = Check("loop join search", expected, RunJoin(loop, search)) and passed;
+
+    // more sub-table tuples than one morsel on several threads switches to the merge join, which
+    // splits the key range at sampled splitters
+    JoinOptions partitioned;
+    partitioned.threadNum = 4;
+    partitioned.morselSize = 64;
+    passed = Check("loop join merge, 4 threads", expected, RunJoin(loop, partitioned)) and passed;
+
+    for (size_t threadNum : {1, 4})
+    {
+        const std::string threads = ", " + std::to_string(threadNum) + (threadNum == 1 ? " thread" : " threads");
+
+        JoinOptions merge = partitioned;
+        merge.threadNum = threadNum;
+        merge.loopJoinMode = LoopJoinMode::Merge;
+        passed = Check("loop join merge mode" + threads, expected, RunJoin(loop, merge)) and passed;
+
+        // adaptive mode weighs the two by costs calibrated at the start of the run
+        JoinOptions adaptive = merge;
+        adaptive.loopJoinMode = LoopJoinMode::Adaptive;
+        passed = Check("loop join adaptive mode" + threads, expected, RunJoin(loop, adaptive)) and passed;
+    }
+
+    return passed;
+}
+
+
+// Relations R0..R(k-1) over X and Y joined by one WCO chain: the kernels specialized for k
+// relations must find the results of the generic kernels in every mode that has them.
+bool CheckFixedKernelJoins()
+{
+    bool passed = true;
+    for (size_t relNum = 2; relNum <= 8; relNum++)
+    {
+        Query query{{"X", "Y"}, [relNum]{
+            std::mt19937 rng(Seed + relNum);
+            std::vector<Relation> relations;
+            for (size_t relId = 0; relId < relNum; relId++)
+                relations.push_back(MakeRelation("R" + std::to_string(relId), {"X", "Y"}, {64, 8}, 1000, rng));
+            return relations;
+        }, [relNum](const std::vector<Relation>& relations){
+            std::vector<size_t> relIds(relNum);
+            std::iota(relIds.begin(), relIds.end(), 0);
+            return MakeWCOChain(relations, relIds, {"X", "Y"});
+        }};
+
+        JoinOptions generic;
+        generic.specializeKernels = false;
+        const size_t expected = RunJoin(query, generic);
+        if (expected == 0)
+        {
+            std::cout << "FAIL " << relNum << " relations reference: no results to compare" << std::endl;
+            passed = false;
+        }
+
+        for (auto [mode, modeName] : {std::pair{IntersectMode::BinarySearch, "binary"}, std::pair{IntersectMode::Galloping, "galloping"},
+                                      std::pair{IntersectMode::Adaptive, "adaptive"}})
+        {
+            JoinOptions specialized;
+            specialized.intersectMode = mode;
+            passed = Check(std::to_string(relNum) + " relations " + modeName + " kernel", expected, RunJoin(query, specialized)) and passed;
+        }
+
+        // interleaved probing takes the place of the specialized binary-search kernels
+        for (auto [mode, modeName] : {std::pair{IntersectMode::BinarySearch, "binary"}, std::pair{IntersectMode::Adaptive, "adaptive"}})
+        {
+            JoinOptions interleaved;
+            interleaved.intersectMode = mode;
+            interleaved.interleave = 8;
+            passed = Check(std::to_string(relNum) + " relations " + modeName + " interleaved", expected, RunJoin(query, interleaved)) and passed;
+        }
+    }
+    return passed;
+}
+
+// The binary-search kernels specialized for 2 to 8 relations on unsorted columns and random range
+// tuples, inverted and empty ones included, as plans binding attributes out of the sort order
+// produce them. Every emitted tuple must be the one of a reference intersection by
+// Attribute::Query, which the generic kernels search with.
+bool CheckFixedKernelTuples()
+{
+    constexpr size_t ColumnLength = 64;
+    constexpr size_t TupleNum = 2000;
+    std::mt19937 rng(Seed);
+    std::uniform_int_distribution<int> valueDist(0, 7);
+    std::uniform_int_distribution<size_t> indexDist(0, ColumnLength);
+
+    bool passed = true;
+    for (size_t relNum = 2; relNum <= 8; relNum++)
+    {
+        // relation 0 does not take part, its range is copied through
+        const size_t width = relNum + 1;
+        std::vector<size_t> relationIndices(relNum);
+        std::iota(relationIndices.begin(), relationIndices.end(), 1);
+
+        std::vector<Attribute<int>> attributes;
+        for (size_t i = 0; i < relNum; i++)
+        {
+            std::vector<int> column(ColumnLength);
+            for (auto& value : column)
+                value = valueDist(rng);
+            attributes.emplace_back(std::move(column));
+        }
+        std::vector<AttributeRef<int>> attrsData(attributes.begin(), attributes.end());
+        TupleKernel kernel = SelectFixedKernel(relationIndices, attrsData, width, false);
+
+        RangeTable input(width, TupleNum), result(width, 0), reference(width, 0);
+        for (size_t index = 0; index < TupleNum; index++)
+        {
+            RangeTuple tuple = input.AcquireTuple();
+            for (size_t relId = 0; relId < width; relId++)
+            {
+                // one range in eight inverted
+                size_t st = indexDist(rng), ed = indexDist(rng);
+                if ((st > ed) != (rng() % 8 == 0))
+                    std::swap(st, ed);
+                tuple[relId] = Range{st, ed};
+            }
+        }
+
+        for (size_t index = 0; index < TupleNum; index++)
+        {
+            RangeTuple tuple = input[index];
+            kernel(tuple, result);
+
+            size_t shortest = 0;
+            for (size_t i = 1; i < relNum; i++)
+                if (tuple[relationIndices[i]].Length() < tuple[relationIndices[shortest]].Length())
+                    shortest = i;
+            Range baseRange = tuple[relationIndices[shortest]];
+            const auto& base = attributes[shortest];
+            for (size_t attrIndex = baseRange.st; attrIndex < baseRange.ed; attrIndex++)
+            {
+                int value = base[attrIndex];
+                if (attrIndex != baseRange.st and value == base[attrIndex - 1])
+                    continue;
+
+                std::vector<Range> found(relNum);
+                bool valueExist = true;
+                for (size_t i = 0; i < relNum and valueExist; i++)
+                {
+                    auto [start, end] = attributes[i].Query(tuple[relationIndices[i]].st, tuple[relationIndices[i]].ed, value);
+                    found[i] = Range{size_t(start - attributes[i].Raw().begin()), size_t(end - attributes[i].Raw().begin())};
+                    valueExist = start != end;
+                }
+                if (!valueExist)
+                    continue;
+
+                RangeTuple storeTuple = reference.AcquireTuple();
+                std::copy_n(tuple, width, storeTuple);
+                for (size_t i = 0; i < relNum; i++)
+                    storeTuple[relationIndices[i]] = found[i];
+            }
+        }
+
+        bool same = result.Length() == reference.Length();
+        for (size_t index = 0; index < result.Length() and same; index++)
+            for (size_t relId = 0; relId < width and same; relId++)
+                same = result[index][relId].st == reference[index][relId].st and result[index][relId].ed == reference[index][relId].ed;
+        std::cout << (same ? "ok   " : "FAIL ") << relNum << " relations binary kernel on random range tuples: "
+                  << result.Length() << " tuples" << std::endl;
+        passed = same and passed;
+    }
+    return passed;
+}
+
+} // namespace
+
+
+int main()
+{
+    bool passed = CheckLoopJoins();
+    passed = CheckFixedKernelJoins() and passed;
+    passed = CheckFixedKernelTuples() and passed;
+
+    std::cout << (passed ? "All checks passed" : "Some checks failed") << std::endl;
+    return passed ? 0 : 1;
+}
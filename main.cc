@@ -1,11 +1,19 @@
+#include "Estimator.h"
 #include "GenericJoin.h"
+#include "Interleave.h"
+#include "Intersection.h"
+#include "LeapfrogJoin.h"
 #include "LoadFile.h"
 #include "Optimizer.h"
+#include "Sampler.h"
 #include "Timer.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace
 {
@@ -35,6 +43,133 @@ void PrintRelation(const Relation& relation)
 }
 
 
+// Comma separated items of an option value
+std::vector<std::string> SplitList(const std::string& value)
+{
+    std::vector<std::string> items;
+    size_t st = 0;
+    while (st <= value.size())
+    {
+        size_t ed = std::min(value.find(',', st), value.size());
+        if (ed > st)
+            items.push_back(value.substr(st, ed - st));
+        st = ed + 1;
+    }
+    return items;
+}
+
+
+// Optional arguments after dataDir and queryDir, in the form --key=value
+JoinOptions ParseJoinOptions(int argc, char* argv[])
+{
+    JoinOptions options;
+    for (int argIndex = 3; argIndex < argc; argIndex++)
+    {
+        std::string arg = argv[argIndex];
+        std::string key = arg.substr(0, arg.find('='));
+        std::string value = arg.find('=') == std::string::npos ? "" : arg.substr(arg.find('=') + 1);
+
+        if (key == "--engine" and value == "generic")
+            options.engine = JoinEngine::Generic;
+        else if (key == "--engine" and value == "leapfrog")
+            options.engine = JoinEngine::Leapfrog;
+        else if (key == "--intersect" and value == "binary")
+            options.intersectMode = IntersectMode::BinarySearch;
+        else if (key == "--intersect" and value == "galloping")
+            options.intersectMode = IntersectMode::Galloping;
+        else if (key == "--intersect" and value == "simd")
+            options.intersectMode = IntersectMode::Simd;
+        else if (key == "--intersect" and value == "bitmap")
+            options.intersectMode = IntersectMode::Bitmap;
+        else if (key == "--intersect" and value == "batched")
+            options.intersectMode = IntersectMode::Batched;
+        else if (key == "--intersect" and value == "adaptive")
+            options.intersectMode = IntersectMode::Adaptive;
+        else if (key == "--batch-size")
+            options.batchSize = std::max<size_t>(std::stoul(value), 1);
+        else if (key == "--search-index")
+            options.searchIndexThreshold = std::stoul(value);
+        else if (key == "--semijoin")
+            options.semiJoin = true;
+        else if (key == "--lp-solver" and value == "builtin")
+            options.lpSolver = "BUILTIN";
+        else if (key == "--lp-solver" and value == "glop")
+            options.lpSolver = "GLOP";
+        else if (key == "--estimator" and value == "agm")
+            options.estimateModel = EstimateModel::Agm;
+        else if (key == "--estimator" and value == "degree")
+            options.estimateModel = EstimateModel::Degree;
+        else if (key == "--estimator" and value == "sample")
+            options.estimateModel = EstimateModel::Sample;
+        else if (key == "--estimator" and value == "hybrid")
+            options.estimateModel = EstimateModel::Hybrid;
+        else if (key == "--sample-walks")
+            options.sampleWalks = std::stoul(value);
+        else if (key == "--sample-time")
+            options.sampleMillis = std::stod(value);
+        else if (key == "--estimate-cache")
+            options.estimateCachePath = value;
+        else if (key == "--group-by")
+            options.groupBy = SplitList(value);
+        else if (key == "--aggregate")
+            for (auto& item : SplitList(value))
+                options.aggregates.push_back(ParseAggregateSpec(item));
+        else if (key == "--limit")
+            options.limit = std::stoul(value);
+        else if (key == "--exists")
+        {
+            options.limit = 1;
+            options.exists = true;
+        }
+        else if (key == "--ordered")
+            options.ordered = true;
+        else if (key == "--intersect-cache")
+            options.intersectCacheBytes = std::stoul(value) << 20;
+        else if (key == "--interleave")
+            options.interleave = std::min<size_t>(std::stoul(value), MaxInterleave);
+        else if (key == "--bitmap-threshold")
+            options.bitmapThreshold = std::stoul(value);
+        else if (key == "--eh-merge" and value == "merge")
+            options.ehMerge = EHMergeMode::Merge;
+        else if (key == "--eh-merge" and value == "hash")
+            options.ehMerge = EHMergeMode::Hash;
+        else if (key == "--loop-join" and value == "search")
+            options.loopJoinMode = LoopJoinMode::BinarySearch;
+        else if (key == "--loop-join" and value == "merge")
+            options.loopJoinMode = LoopJoinMode::Merge;
+        else if (key == "--loop-join" and value == "adaptive")
+            options.loopJoinMode = LoopJoinMode::Adaptive;
+        else if (key == "--calibration")
+            options.calibrationPath = value;
+        else if (key == "--stats")
+            options.printStats = true;
+        else if (key == "--gallop-ratio")
+            options.gallopRatio = std::max<size_t>(std::stoul(value), 1);
+        else if (key == "--heavy-threshold")
+            options.heavyThreshold = std::stoul(value);
+        else if (key == "--generic-kernels")
+            options.specializeKernels = false;
+        else if (key == "--threads")
+            options.threadNum = std::max<size_t>(std::stoul(value), 1);
+        else if (key == "--morsel-size")
+            options.morselSize = std::max<size_t>(std::stoul(value), 1);
+        else if (key == "--preserve-order")
+            options.preserveOrder = true;
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    if (!options.groupBy.empty() and options.aggregates.empty())
+        options.aggregates.push_back(AggregateSpec{AggregateOp::Count, ""});
+    if (!options.aggregates.empty() and options.limit > 0)
+        throw std::invalid_argument("--limit and --exists do not combine with aggregation");
+    if (options.sampleWalks == 0 and options.sampleMillis <= 0)
+        throw std::invalid_argument("--sample-walks=0 needs a --sample-time budget");
+
+    return options;
+}
+
+
 }
 
 std::string DatabasePath;
@@ -54,6 +189,10 @@ int main(int argc, char* argv[])
     QueryPath = DatabasePath + "sql/" + std::string(argv[2]);
     std::cout << "query path: " << QueryPath << std::endl;
     // }
+    JoinOptions joinOptions = ParseJoinOptions(argc, argv);
+    if (joinOptions.intersectMode == IntersectMode::Simd or joinOptions.intersectMode == IntersectMode::Bitmap or
+        joinOptions.intersectMode == IntersectMode::Adaptive)
+        std::cout << "SIMD level: " << SimdLevelName(DetectSimdLevel()) << std::endl;
 
     std::string schemaPath = QueryPath;
     Schema schema(schemaPath);
@@ -77,13 +216,30 @@ int main(int argc, char* argv[])
     // for (size_t relIndex = 0; relIndex < GloablData::GRelation.size(); relIndex++)
     //     relationRefs.push_back(GloablData::GRelation[relIndex]);
 
+    Estimator::SetDefaultSolver(joinOptions.lpSolver);
+    JoinSampler::Shared().SetBudget(joinOptions.sampleWalks, joinOptions.sampleMillis);
+    if (!joinOptions.estimateCachePath.empty())
+        EstimateCache::Shared().Load(joinOptions.estimateCachePath);
+
     Timer tm("timer");
     LTOptimizer* optimizer = new EHLTOptimizer(std::move(relationRefs), attrNames);
     // LTOptimizer* optimizer = new DPLTOptimizer();
     auto attrNum = attrNames.size();
+    optimizer->SetEstimateModel(joinOptions.estimateModel);
     auto plan = optimizer->operator()();
 
     auto opTime = tm.Timing();
+    EstimateCache::Shared().Save();
+    if (joinOptions.printStats)
+    {
+        const EstimateCache& estimates = EstimateCache::Shared();
+        std::cout << "Estimates: " << estimates.Misses() << " computed, " << estimates.Loaded() << " loaded, " << estimates.Hits() << " cached" << std::endl;
+        const JoinSampler& sampler = JoinSampler::Shared();
+        if (sampler.EstimateNum() > 0)
+            std::cout << "Sampling: " << sampler.EstimateNum() << " estimates, " << sampler.WalkNum() << " walks, " << sampler.SurvivedWalkNum()
+                      << " survived, relative standard error " << sampler.MeanRelativeError() << " mean, " << sampler.MaxRelativeError() << " max" << std::endl;
+    }
+    JoinSampler::Shared().ReleaseProjections();
     std::cout << "GVO: ";
     for (auto v : optimizer->GVO)
         std::cout << v << ' ';
@@ -103,8 +259,17 @@ int main(int argc, char* argv[])
     auto stJoin = tm.Timing();
 
     // calculate
-    GenericJoin join(std::move(plan), std::move(relations), std::move(attrNames));
-    join();
+    if (joinOptions.engine == JoinEngine::Leapfrog)
+    {
+        LeapfrogTrieJoin join(std::move(relations), optimizer->GVO);
+        join();
+    }
+    else
+    {
+        joinOptions.gvo = optimizer->GVO;
+        GenericJoin join(std::move(plan), std::move(relations), std::move(attrNames), joinOptions);
+        join();
+    }
     // plan->Execute();
 
     auto edJoin = tm.Timing();
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Interleave.h"
+#include "SearchIndex.h"
+#include "Timer.h"
+
+
+// Probe throughput of the binary searches in the join operators: plain std::lower_bound /
+// upper_bound loops against the same searches through a KarySearchIndex, and written as
+// coroutines run through Interleave with growing windows.
+// Usage: ./probeBench [log2 column length] [probe number]
+
+
+// the search of ProbeRanges in GenericJoin.cc for one range
+ProbeTask ProbeColumn(const int* column, size_t length, int value, size_t* matches)
+{
+    size_t bounds[2];
+    for (size_t upper = 0; upper < 2; upper++)
+    {
+        size_t base = upper ? bounds[0] : 0;
+        size_t n = length - base;
+        while (n > 0)
+        {
+            size_t half = n / 2;
+            co_await Prefetch{column + base + half};
+            bool right = upper ? column[base + half] <= value : column[base + half] < value;
+            base = right ? base + half + 1 : base;
+            n = right ? n - half - 1 : half;
+        }
+        bounds[upper] = base;
+    }
+
+    *matches = bounds[1] - bounds[0];
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t lengthLog = argc > 1 ? std::stoul(argv[1]) : 24;
+    size_t probeNum = argc > 2 ? std::stoul(argv[2]) : (1 << 20);
+    size_t length = size_t(1) << lengthLog;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist(0, static_cast<int>(std::min<size_t>(length * 2, 1u << 30)));
+    std::vector<int> column(length);
+    for (auto& value : column)
+        value = dist(rng);
+    std::sort(column.begin(), column.end());
+
+    std::vector<int> probes(probeNum);
+    for (auto& value : probes)
+        value = dist(rng);
+
+    std::cout << "column " << length << " ints, " << probeNum << " probes" << std::endl;
+
+    auto report = [&](const std::string& name, double seconds, size_t checksum){
+        std::cout << name << ": " << probeNum / seconds / 1e6 << " Mprobes/s (" << seconds << "s, matches " << checksum << ")" << std::endl;
+    };
+
+    {
+        Timer timer("plain");
+        size_t checksum = 0;
+        for (int value : probes)
+            checksum += std::upper_bound(column.begin(), column.end(), value) - std::lower_bound(column.begin(), column.end(), value);
+        report("plain", timer.Timing(), checksum);
+    }
+
+    {
+        KarySearchIndex<int> index;
+        index.Build(column.data(), length);
+        Timer timer("k-ary");
+        size_t checksum = 0;
+        for (int value : probes)
+            checksum += index.Bound(column.data(), 0, length, value, true) - index.Bound(column.data(), 0, length, value, false);
+        report("k-ary index", timer.Timing(), checksum);
+    }
+
+    std::vector<size_t> matches(probeNum);
+    for (size_t width : {1, 2, 4, 8, 16, 32, 64})
+    {
+        Timer timer("interleaved");
+        Interleave(probeNum, width, [&](size_t probe){
+            return ProbeColumn(column.data(), length, probes[probe], &matches[probe]);
+        });
+        size_t checksum = 0;
+        for (size_t count : matches)
+            checksum += count;
+        report("interleave " + std::to_string(width), timer.Timing(), checksum);
+    }
+
+    return 0;
+}